@@ -0,0 +1,179 @@
+/*
+  ==============================================================================
+
+    Real-time hit/miss detection, run on the audio thread inside processBlock().
+
+    Every note-on that has not found its partner yet waits in a fixed-size FIFO
+    (in arrival order, so they also expire in that order) and in a small per-pitch
+    slot table. An incoming note-on looks only at the pending notes of the other
+    channel with the same pitch: the nearest one is a hit. A pending note that is
+    still unmatched after the threshold is a miss. Nothing allocates or locks.
+
+    Worst-case cost of one block with E note-ons:
+      - every note-on scans at most pitchSlots entries of its pitch and does one
+        O(1) insert,
+      - every FIFO entry expires exactly once, and at most queueCapacity of them
+        can be pending, so a block pops at most E + queueCapacity entries,
+    which is at most E * (pitchSlots + 2) + queueCapacity entry visits
+    (worstCaseEntryVisits). The scan and insert part is a fixed pitchSlots + 1 per
+    note-on, by construction; what depends on the traffic is the number of
+    expiries, which getEntryVisits() counts along with it, so the test in
+    MidiDiffLiveMatcherTest.cpp checks the expiry part of the bound. At most
+    maxFeedbackPerBlock results are reported per block; any further ones are
+    only counted in droppedFeedback.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+class MidiDiffLiveMatcher
+{
+public:
+    static constexpr int queueCapacity = 1024;
+    static constexpr int pitchSlots = 8;
+    static constexpr int maxFeedbackPerBlock = 256;
+
+    static constexpr int64_t worstCaseEntryVisits(int64_t noteOnsInBlock) {
+        return noteOnsInBlock * (pitchSlots + 2) + queueCapacity;
+    }
+
+    struct Feedback
+    {
+        int sampleOffset;
+        bool hit;
+    };
+
+    void prepare(double newSampleRate) {
+        sampleRate = newSampleRate;
+        head = tail = 0;
+        for (auto& kind : slots) {
+            for (auto& pitch : kind) {
+                for (auto& slot : pitch) { slot = 0; }
+            }
+        }
+        for (auto& kind : nextSlot) {
+            for (auto& next : kind) { next = 0; }
+        }
+        feedbackCount = 0;
+    }
+
+    // blockStart is the running sample position of the first sample of the block
+    void beginBlock(int64_t newBlockStart, int newBlockSize, int thresholdMillis) {
+        blockStart = newBlockStart;
+        blockSize = newBlockSize;
+        thresholdSamples = int64_t(thresholdMillis * sampleRate / 1000.0);
+        feedbackCount = 0;
+        entryVisits = 0;
+    }
+
+    // note-ons have to arrive in sample order, as a MidiBuffer iterates them
+    void noteOn(int sampleOffset, int pitch, bool isReference) {
+        int64_t time = blockStart + sampleOffset;
+        expireUntil(time);
+
+        int kind = isReference ? 0 : 1;
+        int other = 1 - kind;
+        pitch &= 127;
+
+        int bestSlot = -1;
+        int64_t bestDistance = 0;
+        entryVisits += pitchSlots + 1;
+        for (int i = 0; i < pitchSlots; i++) {
+            uint64_t sequence = slots[other][pitch][i];
+            if (sequence == 0 || sequence - 1 < head) { continue; }
+            auto& entry = queue[(sequence - 1) % queueCapacity];
+            if (! entry.pending) { continue; }
+            int64_t distance = std::llabs(time - entry.time);
+            if (distance <= thresholdSamples && (bestSlot < 0 || distance < bestDistance)) {
+                bestSlot = i;
+                bestDistance = distance;
+            }
+        }
+
+        if (bestSlot >= 0) {
+            queue[(slots[other][pitch][bestSlot] - 1) % queueCapacity].pending = false;
+            slots[other][pitch][bestSlot] = 0;
+            report(sampleOffset, true);
+            return;
+        }
+
+        if (tail - head == queueCapacity) { expireHead(); }
+        queue[tail % queueCapacity] = { time, true };
+        slots[kind][pitch][nextSlot[kind][pitch]] = tail + 1;
+        nextSlot[kind][pitch] = uint8_t((nextSlot[kind][pitch] + 1) % pitchSlots);
+        tail++;
+    }
+
+    void endBlock() {
+        expireUntil(blockStart + blockSize);
+    }
+
+    int getNumFeedback() const {
+        return feedbackCount;
+    }
+
+    const Feedback& getFeedback(int index) const {
+        return feedback[index];
+    }
+
+    // slot scans, inserts and expiries since beginBlock()
+    int64_t getEntryVisits() const {
+        return entryVisits;
+    }
+
+    uint64_t droppedFeedback = 0;
+
+private:
+    struct Entry
+    {
+        int64_t time;
+        bool pending;
+    };
+
+    void expireUntil(int64_t time) {
+        while (head < tail && queue[head % queueCapacity].time + thresholdSamples < time) {
+            expireHead();
+        }
+    }
+
+    void expireHead() {
+        auto& entry = queue[head % queueCapacity];
+        if (entry.pending) {
+            int64_t offset = entry.time + thresholdSamples + 1 - blockStart;
+            if (offset >= blockSize) { offset = blockSize - 1; }
+            report(int(offset < 0 ? 0 : offset), false);
+        }
+        entryVisits++;
+        head++;
+    }
+
+    void report(int sampleOffset, bool hit) {
+        if (feedbackCount == maxFeedbackPerBlock) {
+            droppedFeedback++;
+            return;
+        }
+        feedback[feedbackCount++] = { sampleOffset, hit };
+    }
+
+    double sampleRate = 44100.0;
+    int64_t blockStart = 0;
+    int blockSize = 0;
+    int64_t thresholdSamples = 0;
+    int64_t entryVisits = 0;
+
+    // FIFO of pending note-ons, entry n lives at queue[n % queueCapacity] while head <= n < tail
+    Entry queue[queueCapacity];
+    uint64_t head = 0;
+    uint64_t tail = 0;
+
+    // [reference, performance][pitch] -> FIFO index + 1 of the latest note-ons, 0 if empty
+    uint64_t slots[2][128][pitchSlots] = {};
+    uint8_t nextSlot[2][128] = {};
+
+    Feedback feedback[maxFeedbackPerBlock];
+    int feedbackCount = 0;
+};
@@ -0,0 +1,123 @@
+/*
+  ==============================================================================
+
+    Tests of MidiDiffLiveMatcher: hit/miss classification, the sample offsets
+    of the results and the worst-case cost of a block.
+
+    They are compiled when JUCE_UNIT_TESTS is enabled and run in the "MidiDiff"
+    category, e.g. with juce::UnitTestRunner().runTestsInCategory("MidiDiff").
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "MidiDiffLiveMatcher.h"
+
+#if JUCE_UNIT_TESTS
+
+class MidiDiffLiveMatcherTest : public juce::UnitTest
+{
+public:
+    MidiDiffLiveMatcherTest() : juce::UnitTest("MidiDiffLiveMatcher", "MidiDiff") {}
+
+    void runTest() override
+    {
+        // 1000 Hz, so that a sample is a millisecond
+        auto matcher = std::make_unique<MidiDiffLiveMatcher>();
+
+        beginTest("A note of the other channel within the threshold is a hit");
+        {
+            matcher->prepare(1000.0);
+            matcher->beginBlock(0, 512, 100);
+            matcher->noteOn(10, 60, true);
+            matcher->noteOn(50, 60, false);
+            matcher->endBlock();
+
+            expectEquals(matcher->getNumFeedback(), 1);
+            expect(matcher->getFeedback(0).hit);
+            expectEquals(matcher->getFeedback(0).sampleOffset, 50);
+        }
+
+        beginTest("A note of the same channel or another pitch is no hit");
+        {
+            matcher->prepare(1000.0);
+            matcher->beginBlock(0, 512, 100);
+            matcher->noteOn(10, 60, true);
+            matcher->noteOn(20, 60, true);
+            matcher->noteOn(30, 61, false);
+            matcher->endBlock();
+
+            expectEquals(matcher->getNumFeedback(), 3);
+            for (int i = 0; i < matcher->getNumFeedback(); i++)
+                expect(! matcher->getFeedback(i).hit);
+        }
+
+        beginTest("The nearest pending note is taken");
+        {
+            matcher->prepare(1000.0);
+            matcher->beginBlock(0, 512, 100);
+            matcher->noteOn(10, 60, false);
+            matcher->noteOn(60, 60, false);
+            matcher->noteOn(70, 60, true);
+            matcher->endBlock();
+
+            // the hit at 70, then the miss of the note at 10, which expired at 111
+            expectEquals(matcher->getNumFeedback(), 2);
+            expect(matcher->getFeedback(0).hit);
+            expectEquals(matcher->getFeedback(0).sampleOffset, 70);
+            expect(! matcher->getFeedback(1).hit);
+            expectEquals(matcher->getFeedback(1).sampleOffset, 111);
+        }
+
+        beginTest("A miss is reported one sample after the threshold ran out, in a later block if needed");
+        {
+            matcher->prepare(1000.0);
+            matcher->beginBlock(0, 512, 100);
+            matcher->noteOn(500, 60, true);
+            matcher->endBlock();
+            expectEquals(matcher->getNumFeedback(), 0);
+
+            matcher->beginBlock(512, 512, 100);
+            matcher->endBlock();
+            expectEquals(matcher->getNumFeedback(), 1);
+            expect(! matcher->getFeedback(0).hit);
+            expectEquals(matcher->getFeedback(0).sampleOffset, 500 + 101 - 512);
+        }
+
+        beginTest("A full queue and 512 note-ons stay within worstCaseEntryVisits");
+        {
+            matcher->prepare(1000.0);
+
+            // fill the queue with reference notes that cannot expire yet
+            matcher->beginBlock(0, MidiDiffLiveMatcher::queueCapacity, 2000);
+            for (int i = 0; i < MidiDiffLiveMatcher::queueCapacity; i++)
+                matcher->noteOn(i, i % 128, true);
+            matcher->endBlock();
+            expectEquals(matcher->getNumFeedback(), 0);
+            expect(matcher->getEntryVisits() <= MidiDiffLiveMatcher::worstCaseEntryVisits(MidiDiffLiveMatcher::queueCapacity));
+
+            // long after the threshold: every pending note expires, the new ones overflow the feedback
+            const int noteOns = 512;
+            auto droppedBefore = matcher->droppedFeedback;
+            matcher->beginBlock(10000, 4096, 2000);
+            for (int i = 0; i < noteOns; i++)
+                matcher->noteOn(i * 8, (i * 7) % 128, (i & 1) == 0);
+            matcher->endBlock();
+
+            expect(matcher->getEntryVisits() <= MidiDiffLiveMatcher::worstCaseEntryVisits(noteOns));
+            expect(matcher->getEntryVisits() >= MidiDiffLiveMatcher::queueCapacity);
+            expectEquals(matcher->getNumFeedback(), MidiDiffLiveMatcher::maxFeedbackPerBlock);
+            expect(matcher->droppedFeedback > droppedBefore);
+
+            for (int i = 0; i < matcher->getNumFeedback(); i++)
+            {
+                auto offset = matcher->getFeedback(i).sampleOffset;
+                expect(offset >= 0 && offset < 4096);
+            }
+        }
+    }
+};
+
+static MidiDiffLiveMatcherTest midiDiffLiveMatcherTest;
+
+#endif
@@ -0,0 +1,167 @@
+/*
+  ==============================================================================
+
+    Loop-pass practice: when a section is looped, every pass is scored on its
+    own against a reference recorded once.
+
+    The reference notes of the first whole pass (one that starts at the loop
+    start) are sorted by pitch and time into a fixed array and kept for good;
+    reference notes of later passes are ignored, so the reference does not grow
+    with the number of passes. Performance notes are stored in pass-relative
+    time; when the pass wraps they are sorted the same way and every reference
+    note is looked up in them with a binary search. The scores go into a small
+    ring buffer that the message thread can read at any time.
+
+    All of this runs on the audio thread, in fixed-size arrays: a wrap costs
+    O(p log p + r log p) for p performance and r reference notes, both at most
+    maxNotesPerPass.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+class MidiDiffLoopPractice
+{
+public:
+    static constexpr int maxNotesPerPass = 2048;
+    static constexpr int historyCapacity = 256;
+
+    struct PassScore
+    {
+        int32_t pass;
+        int16_t percentage;
+        int16_t inThreshold;
+    };
+
+    // audio thread
+    void reset() {
+        state = waitingForWholePass;
+        referenceCount = 0;
+        performanceCount = 0;
+        currentPassWhole = false;
+        passNumber = 0;
+        scoredPasses.store(0, std::memory_order_release);
+    }
+
+    // Called when a new pass begins. previousCompleted: the previous pass ran until the loop
+    // wrapped (it was not stopped or relocated). startsWhole: this pass starts at the loop start.
+    void startPass(bool previousCompleted, bool startsWhole, int threshold) {
+        bool previousWhole = currentPassWhole && previousCompleted;
+
+        if (state == recordingReference) {
+            if (previousWhole && referenceCount > 0) {
+                std::sort(reference, reference + referenceCount);
+                state = scoring;
+            }
+            else {
+                state = waitingForWholePass;
+                referenceCount = 0;
+            }
+        }
+        if (state == scoring && previousWhole) {
+            scorePass(threshold);
+        }
+        if (state == waitingForWholePass && startsWhole) {
+            state = recordingReference;
+            referenceCount = 0;
+        }
+
+        performanceCount = 0;
+        currentPassWhole = startsWhole;
+        passNumber++;
+    }
+
+    void noteOn(double passMillis, int note, bool isReference) {
+        if (! currentPassWhole) { return; }
+
+        Note entry { note, int32_t(passMillis) };
+        if (isReference) {
+            if (state == recordingReference && referenceCount < maxNotesPerPass) {
+                reference[referenceCount++] = entry;
+            }
+        }
+        else if (state != waitingForWholePass && performanceCount < maxNotesPerPass) {
+            performance[performanceCount++] = entry;
+        }
+    }
+
+    bool hasReference() const {
+        return state == scoring;
+    }
+
+    // message thread: copies the most recent scores, oldest first, returns their number
+    int getHistory(PassScore* destination, int maxScores) const {
+        auto count = scoredPasses.load(std::memory_order_acquire);
+        auto available = int(std::min<uint32_t>(count, uint32_t(std::min(maxScores, historyCapacity))));
+        for (int i = 0; i < available; i++) {
+            destination[i] = history[(count - uint32_t(available) + uint32_t(i)) % historyCapacity];
+        }
+        return available;
+    }
+
+private:
+    struct Note
+    {
+        int note;
+        int32_t time;
+
+        bool operator<(const Note& other) const {
+            return note < other.note || (note == other.note && time < other.time);
+        }
+    };
+
+    void scorePass(int threshold) {
+        std::sort(performance, performance + performanceCount);
+
+        int64_t sumOfDistances = 0;
+        int inThresholdCount = 0;
+        for (int i = 0; i < referenceCount; i++) {
+            auto distance = nearestDistance(reference[i], threshold);
+            if (distance < threshold) { inThresholdCount++; }
+            sumOfDistances += distance;
+        }
+
+        PassScore score { passNumber, 0, 0 };
+        if (referenceCount > 0 && threshold > 0) {
+            double averageDistance = sumOfDistances * 1.0 / referenceCount;
+            score.percentage = int16_t(100 - (averageDistance * 100.0 / threshold));
+            score.inThreshold = int16_t(inThresholdCount * 100.0 / referenceCount);
+        }
+
+        auto count = scoredPasses.load(std::memory_order_relaxed);
+        history[count % historyCapacity] = score;
+        scoredPasses.store(count + 1, std::memory_order_release);
+    }
+
+    int nearestDistance(const Note& target, int threshold) const {
+        auto end = performance + performanceCount;
+        auto found = std::lower_bound(performance, end, target);
+        int best = threshold;
+        if (found != end && found->note == target.note) {
+            best = std::min(best, int(std::abs(found->time - target.time)));
+        }
+        if (found != performance && (found - 1)->note == target.note) {
+            best = std::min(best, int(std::abs((found - 1)->time - target.time)));
+        }
+        return best;
+    }
+
+    enum State { waitingForWholePass, recordingReference, scoring };
+    State state = waitingForWholePass;
+    bool currentPassWhole = false;
+    int32_t passNumber = 0;
+
+    Note reference[maxNotesPerPass];
+    int referenceCount = 0;
+    Note performance[maxNotesPerPass];
+    int performanceCount = 0;
+
+    PassScore history[historyCapacity];
+    std::atomic<uint32_t> scoredPasses { 0 };
+};
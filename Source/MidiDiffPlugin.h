@@ -51,9 +51,17 @@
 #pragma once
 
 #include <iterator>
+#include "MidiDiffResultFeed.h"
+#include "MidiDiffTimeWarp.h"
+#include "MidiDiffLiveMatcher.h"
+#include "MidiDiffScoreCurve.h"
+#include "MidiDiffLoopPractice.h"
+#include "MidiDiffScoreTimeline.h"
+#include "MidiDiffTakes.h"
 using namespace std;
 using namespace std::chrono;
 typedef vector< tuple<long, int> > EventListType;
+typedef vector< tuple<long, int, int> > MatchListType;
 
 
 class MidiDiffResult
@@ -81,6 +89,14 @@ public:
     int getLastUsedMidiChannel () {
         return lastUsedMidiChannel;
     }
+
+    int getPercentage() {
+        return percentage;
+    }
+
+    int getInThresholdPercentage() {
+        return inThreshold;
+    }
 };
 
 
@@ -88,49 +104,280 @@ class MidiDiffModel
 {
 public: 
     //mididiff variables begin
-    int threshold = 100;
+    // the settings below that the audio thread reads (or writes) are atomic, the editor changes them
+    std::atomic<int> threshold { 200 };
+    // distances are kept up to this, so that any threshold below it can be answered from scoreCurve
+    static constexpr int minThreshold = 10;
+    static constexpr int maxThreshold = 2000;
+    // notes of the current take, only touched by the message thread (see collectNotes())
     EventListType controlMidiEvents;
     EventListType performanceMidiEvents;
 
-    int lastUsedMidiChannel = -1;
-    int midiChannelReference = 1;
-    int midiChannelPerformance = 10;
+    // Starting a new take only bumps the epoch. The audio thread tags every note with the epoch
+    // it saw, and the message thread seals the previous take when the first note of a newer
+    // epoch, or the new epoch itself, shows up.
+    std::atomic<uint32_t> takeEpoch { 0 };
+    MidiDiffTakeHistory takes;
+
+    std::atomic<int> lastUsedMidiChannel { -1 };
+    // bit n - 1 is set when channel n was used since the last takeChannelActivity()
+    std::atomic<uint16_t> channelActivity { 0 };
+    std::atomic<int> midiChannelReference { 1 };
+    std::atomic<int> midiChannelPerformance { 10 };
+
+    // ids of the alignment selector
+    enum AlignmentMode { nearestAlignment = 1, warpedAlignment = 2 };
+    int alignmentMode = nearestAlignment;
+    int warpBandRadius = 128;
+
+    // real-time hit/miss output, ids of the feedback selector
+    enum FeedbackMode { feedbackOff = 1, feedbackNotes = 2, feedbackControllers = 3 };
+    std::atomic<int> feedbackMode { feedbackOff };
+    std::atomic<int> feedbackChannel { 16 };
+    std::atomic<int> feedbackHitNumber { 60 };     // note or CC number
+    std::atomic<int> feedbackMissNumber { 61 };
+    std::atomic<int> feedbackValue { 127 };        // velocity or CC value
+
+    // per-pass scoring of a looped section, loopPasses is owned by the audio thread
+    std::atomic<bool> loopPracticeEnabled { false };
+    MidiDiffLoopPractice loopPasses;
+
+    // note-ons beyond this in a single block, or beyond the room in the note FIFO, are not scored, only counted
+    static constexpr int noteOnBudgetPerBlock = 256;
+    std::atomic<uint64_t> droppedNoteOns { 0 };
+
+    // (reference time, note, distance) of each reference note, filled by calculateResult(),
+    // the distance is maxThreshold when there was no match
+    MatchListType lastMatches;
+    MidiDiffScoreCurve scoreCurve;
+    // Matches enter the timeline once they settled and keep the value they had then: in nearest
+    // mode no later note can change them, in warped mode they may still shift slightly with the
+    // global path. Later threshold or alignment changes only apply to matches settled afterwards.
+    MidiDiffScoreTimeline timeline;
+    // epoch millis of the last rescore, 0 before the first one
+    long scoredAtMillis = 0;
+
+    // the most recently settled matches of all takes, settled match n is at settledRing[n % settledRingCapacity]
+    static constexpr int settledRingCapacity = int(MidiDiffFeedSnapshot::matchCapacity);
+    MidiDiffFeedMatch settledRing[settledRingCapacity];
+    uint64_t settledMatchCount = 0;
+
+    uint16_t takeChannelActivity() {
+        return channelActivity.exchange(0, std::memory_order_relaxed);
+    }
 
-    void resetMidiCounters() {
-        controlMidiEvents.clear();
-        performanceMidiEvents.clear();
+    // O(1) and safe from any thread, the current take is sealed by the next collectNotes()
+    void startNewTake() {
+        takeEpoch.fetch_add(1);
     }
 
-    MidiDiffResult calculateResult() {
-        auto& control = controlMidiEvents;
-        auto& perform = performanceMidiEvents;
+    // audio thread, never blocks
+    void recordNote(long time, int note, bool isReference) {
+        int start1, size1, start2, size2;
+        noteFifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 + size2 == 0) {
+            droppedNoteOns++;
+            return;
+        }
+        noteFifoBuffer[size1 > 0 ? start1 : start2] = { time, note, isReference, takeEpoch.load(std::memory_order_relaxed) };
+        noteFifo.finishedWrite(1);
+    }
 
-        long sumOfDistances = 0;
-        int inThresholdCount = 0;
-        for (const tuple<long, int> controlEvt : control) {
-            long eventTime = std::get<0>(controlEvt);
-            int midiNote = std::get<1>(controlEvt);
-            auto currentDiff = differenceOfSameNotes(eventTime, midiNote, perform);
-            if (currentDiff < threshold) { inThresholdCount++; }
-            sumOfDistances += currentDiff;
+    // message thread: moves the recorded notes into the current take
+    void collectNotes() {
+        int start1, size1, start2, size2;
+        noteFifo.prepareToRead(noteFifo.getNumReady(), start1, size1, start2, size2);
+        collectNotes(start1, size1);
+        collectNotes(start2, size2);
+        noteFifo.finishedRead(size1 + size2);
+
+        if (takeEpoch.load() != currentTakeEpoch) {
+            sealCurrentTake(takeEpoch.load());
+        }
+    }
+
+    // result of a completed take at any threshold, without rescoring
+    MidiDiffResult takeResultAt(const MidiDiffTake& take, int currentThreshold) {
+        auto& curve = take.getScoreCurve();
+        return MidiDiffResult(int(curve.percentageAt(currentThreshold)), lastUsedMidiChannel, int(curve.inThresholdAt(currentThreshold)));
+    }
+
+    // whether a kept take was scored with another alignment than the current one
+    bool isStale(const MidiDiffTake& take) const {
+        return take.getAlignment() != alignmentMode;
+    }
+
+    int countStaleTakes() const {
+        int stale = 0;
+        for (size_t i = 0; i < takes.size(); i++) {
+            if (isStale(*takes[i])) { stale++; }
+        }
+        return stale;
+    }
+
+    // rescores a kept take with the current alignment
+    void realignTake(size_t index) {
+        auto& take = *takes[index];
+        auto control = take.getReference();
+        auto perform = take.getPerformance();
+        auto distances = scoreDistances(control, perform);
+        takes.replace(index, std::make_shared<const MidiDiffTake>(take.getId(), alignmentMode, control, perform, std::move(distances)), threshold);
+    }
+
+    // After an alignment change the kept takes are rescored a few at a time, at least one and
+    // then only while within budgetMillis, so the message thread never rescores all of them at once.
+    void realignStaleTakes(int budgetMillis) {
+        auto start = steady_clock::now();
+        for (size_t i = 0; i < takes.size(); i++) {
+            if (! isStale(*takes[i])) { continue; }
+            realignTake(i);
+            if (steady_clock::now() - start >= milliseconds(budgetMillis)) { return; }
+        }
+    }
+
+    // Rescores only when notes arrived or the alignment changed since the last call,
+    // a new threshold is answered from scoreCurve. In warped mode every rescore warps the whole
+    // take, so new notes alone are rescored at most every warpedRescoreIntervalMillis.
+    MidiDiffResult calculateResult() {
+        collectNotes();
+        long now = long(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
+
+        auto settingsChanged = rescoreNeeded || alignmentMode != scoredAlignmentMode;
+        auto notesArrived = controlMidiEvents.size() != scoredControlCount
+            || performanceMidiEvents.size() != scoredPerformanceCount;
+        auto warpedRecently = alignmentMode == warpedAlignment && now - scoredAtMillis < warpedRescoreIntervalMillis;
+        if (settingsChanged || (notesArrived && ! warpedRecently)) {
+            rescore();
         }
 
-        auto controlNoteCount = control.size();
-        auto noControl = controlNoteCount == 0;
+        // only matches that the last rescore saw maxThreshold of notes after can settle
+        settleMatches(std::min(now, scoredAtMillis) - maxThreshold);
+        realignStaleTakes(realignBudgetMillis);
+        return resultAt(threshold);
+    };
+
+    MidiDiffResult resultAt(int currentThreshold) {
+        auto noControl = scoreCurve.size() == 0;
         if (noControl) {
             return MidiDiffResult(0, lastUsedMidiChannel, 0);
         }
 
-        int inThreshold = inThresholdCount * 100.0 / controlNoteCount;
-        double averageDistance = sumOfDistances * 1.0 / controlNoteCount;
-        int percentage = 100 - (averageDistance * 100.0 / threshold);
+        int inThreshold = scoreCurve.inThresholdAt(currentThreshold);
+        int percentage = scoreCurve.percentageAt(currentThreshold);
         return MidiDiffResult(percentage, lastUsedMidiChannel, inThreshold);
-    };
+    }
 
 private:
 
-    int differenceOfSameNotes(long controlTime, int controlMidiNote, EventListType currentMidiEvents) {
-        int minDistance = threshold;
+    struct RecordedNote
+    {
+        long time;
+        int note;
+        bool isReference;
+        uint32_t epoch;
+    };
+
+    void collectNotes(int start, int size) {
+        for (int i = start; i < start + size; i++) {
+            auto& recorded = noteFifoBuffer[i];
+            if (recorded.epoch != currentTakeEpoch) {
+                // a note recorded just before a reset that was already sealed
+                if (int32_t(recorded.epoch - currentTakeEpoch) < 0) { continue; }
+                sealCurrentTake(recorded.epoch);
+            }
+            auto& target = recorded.isReference ? controlMidiEvents : performanceMidiEvents;
+            target.push_back(make_tuple(recorded.time, recorded.note));
+        }
+    }
+
+    // Turns the current take into an immutable, scored take and starts the next one. The matches
+    // of the outgoing take that have not settled yet enter the timeline now, as they are final.
+    void sealCurrentTake(uint32_t nextEpoch) {
+        if (! controlMidiEvents.empty()) {
+            std::sort(controlMidiEvents.begin(), controlMidiEvents.end());
+            std::sort(performanceMidiEvents.begin(), performanceMidiEvents.end());
+            rescore();
+            settleMatches(std::get<0>(lastMatches.back()), true);
+
+            vector<int> distances;
+            distances.reserve(lastMatches.size());
+            for (auto& match : lastMatches) { distances.push_back(std::get<2>(match)); }
+            takes.add(std::make_shared<const MidiDiffTake>(currentTakeEpoch, alignmentMode, controlMidiEvents, performanceMidiEvents, std::move(distances)), threshold);
+        }
+        controlMidiEvents.clear();
+        performanceMidiEvents.clear();
+        currentTakeEpoch = nextEpoch;
+        rescore();
+    }
+
+    vector<int> scoreDistances(EventListType& control, EventListType& perform) {
+        if (alignmentMode == warpedAlignment) {
+            return warpedDistances(control, perform);
+        }
+        return nearestDistances(control, perform);
+    }
+
+    void rescore() {
+        EventListType control = controlMidiEvents;
+        EventListType perform = performanceMidiEvents;
+        rescoreNeeded = false;
+        scoredControlCount = control.size();
+        scoredPerformanceCount = perform.size();
+        scoredAlignmentMode = alignmentMode;
+        scoredAtMillis = long(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
+
+        auto distances = scoreDistances(control, perform);
+
+        lastMatches.clear();
+        for (size_t i = 0; i < control.size(); i++) {
+            lastMatches.push_back(make_tuple(std::get<0>(control[i]), std::get<1>(control[i]), distances[i]));
+        }
+        scoreCurve.build(std::move(distances));
+    }
+
+    // Adds the matches of reference notes in (settledUntil, horizon] to the timeline, lastMatches
+    // is in time order so only its tail has to be looked at. In warped mode the residual of a note
+    // depends on the offsets of the residualWindow notes after it, so those are held back too.
+    // When the take ended, everything up to the horizon is settled, as no note will follow.
+    void settleMatches(long horizon, bool takeEnded = false) {
+        if (scoredAlignmentMode == warpedAlignment && ! takeEnded) {
+            auto heldBack = size_t(MidiDiffTimeWarp::residualWindow);
+            if (lastMatches.size() <= heldBack) { return; }
+            horizon = std::min(horizon, std::get<0>(lastMatches[lastMatches.size() - heldBack]) - 1);
+        }
+        if (horizon <= settledUntil) { return; }
+
+        size_t first = lastMatches.size();
+        while (first > 0 && std::get<0>(lastMatches[first - 1]) > settledUntil) {
+            first--;
+        }
+        for (size_t i = first; i < lastMatches.size(); i++) {
+            auto& match = lastMatches[i];
+            if (std::get<0>(match) > horizon) { break; }
+            timeline.add(std::get<0>(match), std::get<2>(match), std::get<2>(match) < threshold);
+            settledRing[settledMatchCount++ % settledRingCapacity] = { std::get<0>(match), std::get<1>(match), std::get<2>(match) };
+        }
+        settledUntil = horizon;
+    }
+
+    vector<int> nearestDistances(const EventListType& control, const EventListType& perform) {
+        vector<int> distances;
+        for (const tuple<long, int> controlEvt : control) {
+            distances.push_back(differenceOfSameNotes(std::get<0>(controlEvt), std::get<1>(controlEvt), perform));
+        }
+        return distances;
+    }
+
+    // sorts both lists by time, then scores the residual deviations after warping
+    vector<int> warpedDistances(EventListType& control, EventListType& perform) {
+        std::sort(control.begin(), control.end());
+        std::sort(perform.begin(), perform.end());
+        auto matches = MidiDiffTimeWarp::align(control, perform, warpBandRadius);
+        return MidiDiffTimeWarp::residualDistances(control, perform, matches, maxThreshold);
+    }
+
+    int differenceOfSameNotes(long controlTime, int controlMidiNote, const EventListType& currentMidiEvents) {
+        int minDistance = maxThreshold;
         for (const tuple<long, int> midiEvt : currentMidiEvents) {
             long eventTime = std::get<0>(midiEvt);
             int midiNote = std::get<1>(midiEvt);
@@ -142,22 +389,38 @@ private:
         return minDistance;
     };
 
+    bool rescoreNeeded = true;
+    size_t scoredControlCount = 0;
+    size_t scoredPerformanceCount = 0;
+    int scoredAlignmentMode = 0;
+    long settledUntil = 0;
+    static constexpr int realignBudgetMillis = 50;
+    static constexpr long warpedRescoreIntervalMillis = 5000;
+
+    static constexpr int noteFifoCapacity = 8192;
+    juce::AbstractFifo noteFifo { noteFifoCapacity };
+    RecordedNote noteFifoBuffer[noteFifoCapacity];
+    uint32_t currentTakeEpoch = 0;
 };
 
 
 
 //==============================================================================
-class MidiDiffPluginProcessor  : public AudioProcessor
+class MidiDiffPluginProcessor  : public AudioProcessor,
+                                 private Timer
 {
 public:
     MidiDiffPluginProcessor()
         : AudioProcessor (getBusesLayout())
     {
-        //startTimerHz (60);
+       #if JUCE_UNIT_TESTS
+        runUnitTestsOnce();
+       #endif
+        startTimerHz (4);
     }
 
     ~MidiDiffPluginProcessor() override { 
-    //    stopTimer(); 
+        stopTimer(); 
     }
 
     long currentBufferEventTimeStartEpochMillis;
@@ -186,7 +449,19 @@ public:
     const String getProgramName (int) override                                { return "None"; }
     void changeProgramName (int, const String&) override                      {}
 
-    void prepareToPlay (double, int) override                                 {}
+    void prepareToPlay (double sampleRate, int) override
+    {
+        liveMatcher.prepare (sampleRate);
+        samplesProcessed = 0;
+        feedbackNoteLength = int (sampleRate * 0.05);
+        feedbackMidi.ensureSize (feedbackMidiBytes);
+
+        // notes still sounding are turned off at the start of the next block
+        for (auto& noteOff : feedbackNoteOff)
+            if (noteOff.offset >= 0)
+                noteOff.offset = 0;
+    }
+
     void releaseResources() override                                          {}
 
     void getStateInformation (MemoryBlock& destData) override
@@ -203,6 +478,39 @@ public:
 
 private:
 
+    // Publishes the live result to the shared-memory feed, whether or not the editor is open. The
+    // score is recalculated once per second (calculateResult() skips it when nothing changed), the
+    // ticks in between only drain the note FIFO. The editor shows the result computed here.
+    void timerCallback() override
+    {
+        if (timerTicks++ % rescoreEveryTicks == 0)
+            model.calculateResult();
+        else
+            model.collectNotes();
+
+        auto result = model.resultAt (model.threshold);
+
+        MidiDiffFeedSnapshot snapshot {};
+        snapshot.percentage = result.getPercentage();
+        snapshot.inThreshold = result.getInThresholdPercentage();
+        snapshot.lastUsedMidiChannel = result.getLastUsedMidiChannel();
+        snapshot.threshold = model.threshold;
+        snapshot.midiChannelReference = model.midiChannelReference;
+        snapshot.midiChannelPerformance = model.midiChannelPerformance;
+        snapshot.publishedAtMillis = long(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
+        snapshot.scoredAtMillis = model.scoredAtMillis;
+
+        // only settled matches are published, they keep their number and value
+        auto settledCount = model.settledMatchCount;
+        auto recentCount = std::min<uint64_t>(settledCount, MidiDiffModel::settledRingCapacity);
+        auto firstIndex = settledCount - recentCount;
+        for (uint64_t i = 0; i < recentCount; i++) {
+            recentFeedMatches[i] = model.settledRing[(firstIndex + i) % MidiDiffModel::settledRingCapacity];
+        }
+
+        feed.publish(snapshot, recentFeedMatches, recentCount, firstIndex);
+    }
+
     class Editor  : public AudioProcessorEditor, juce::Button::Listener,
         private Value::Listener, Timer
     {
@@ -214,7 +522,7 @@ private:
         // inputs
         juce::ComboBox controlMidiChannelSelector;
         juce::ComboBox performanceMidiChannelSelector;
-        juce::ComboBox thresholdSelector;
+        juce::Slider thresholdSlider;
 
         // outputs
         juce::TextButton percentageButton = juce::TextButton("Reset");
@@ -228,19 +536,284 @@ private:
         juce::Label inThresholdLabel{ {}, "In Threshold" };
         juce::Label inThresholdText{ {}, "...3" };
 
+        juce::Label feedLabel{ {}, "Live Feed" };
+        juce::Label feedText{ {}, "-" };
+
+        juce::Label alignmentLabel{ {}, "Alignment" };
+        juce::ComboBox alignmentSelector;
+
+        // percentage (green) and in-threshold ratio (orange) for every threshold, on a log scale
+        class ThresholdCurve : public juce::Component
+        {
+        public:
+            explicit ThresholdCurve(MidiDiffModel& modelIn) : model(modelIn) {}
+
+            // a completed take to draw instead of the current one
+            MidiDiffTakeHistory::TakePtr take;
+
+            void paint(Graphics& g) override
+            {
+                auto bounds = getLocalBounds().toFloat();
+                g.setColour(juce::Colours::black.withAlpha(0.3f));
+                g.fillRect(bounds);
+
+                auto& curve = take ? take->getScoreCurve() : model.scoreCurve;
+                if (curve.size() == 0) { return; }
+
+                juce::Path percentagePath, inThresholdPath;
+                for (int x = 0; x < getWidth(); x++) {
+                    auto threshold = thresholdAt(x);
+                    auto percentageY = valueToY(curve.percentageAt(threshold));
+                    auto inThresholdY = valueToY(curve.inThresholdAt(threshold));
+                    if (x == 0) {
+                        percentagePath.startNewSubPath(0.0f, percentageY);
+                        inThresholdPath.startNewSubPath(0.0f, inThresholdY);
+                    }
+                    else {
+                        percentagePath.lineTo(float(x), percentageY);
+                        inThresholdPath.lineTo(float(x), inThresholdY);
+                    }
+                }
+                g.setColour(juce::Colours::orange);
+                g.strokePath(inThresholdPath, juce::PathStrokeType(1.5f));
+                g.setColour(juce::Colours::lightgreen);
+                g.strokePath(percentagePath, juce::PathStrokeType(1.5f));
+
+                g.setColour(juce::Colours::white);
+                g.drawVerticalLine(xAt(model.threshold), 0.0f, float(getHeight()));
+                g.setFont(12.0f);
+                g.drawText(juce::String(MidiDiffModel::minThreshold) + " ms", getLocalBounds().reduced(2), juce::Justification::topLeft, false);
+                g.drawText(juce::String(MidiDiffModel::maxThreshold) + " ms", getLocalBounds().reduced(2), juce::Justification::topRight, false);
+            }
+
+        private:
+            int thresholdAt(int x) {
+                double position = getWidth() > 1 ? x / double(getWidth() - 1) : 0.0;
+                double ratio = double(MidiDiffModel::maxThreshold) / MidiDiffModel::minThreshold;
+                return int(std::round(MidiDiffModel::minThreshold * std::pow(ratio, position)));
+            }
+
+            int xAt(int threshold) {
+                double ratio = double(MidiDiffModel::maxThreshold) / MidiDiffModel::minThreshold;
+                double position = std::log(double(threshold) / MidiDiffModel::minThreshold) / std::log(ratio);
+                return int(std::round(position * (getWidth() - 1)));
+            }
+
+            float valueToY(double value) {
+                return float((1.0 - juce::jlimit(0.0, 100.0, value) / 100.0) * (getHeight() - 1));
+            }
+
+            MidiDiffModel& model;
+        };
+
+        ThresholdCurve thresholdCurve;
+
+        // In-threshold ratio over the session, one bar per pixel. The wheel zooms around the
+        // mouse, dragging pans and a double click shows the whole session again.
+        class ScoreTimelineView : public juce::Component
+        {
+        public:
+            explicit ScoreTimelineView(MidiDiffModel& modelIn) : model(modelIn) {}
+
+            void paint(Graphics& g) override
+            {
+                g.setColour(juce::Colours::black.withAlpha(0.3f));
+                g.fillRect(getLocalBounds());
+
+                auto& timeline = model.timeline;
+                if (timeline.isEmpty() || getWidth() <= 0) { return; }
+
+                double from, to;
+                visibleRange(from, to);
+                double millisPerPixel = (to - from) / getWidth();
+
+                for (int x = 0; x < getWidth(); x++) {
+                    auto slice = timeline.query(long(from + x * millisPerPixel), long(from + (x + 1) * millisPerPixel));
+                    if (slice.notes == 0) { continue; }
+
+                    auto ratio = float(slice.hits) / slice.notes;
+                    auto height = juce::jmax(1.0f, ratio * getHeight());
+                    g.setColour(ratio >= 0.5f ? juce::Colours::lightgreen : juce::Colours::orange);
+                    g.fillRect(float(x), getHeight() - height, 1.0f, height);
+                }
+
+                g.setColour(juce::Colours::white);
+                g.setFont(12.0f);
+                g.drawText(isZoomed() ? juce::String((to - from) / 1000.0, 1) + " s" : juce::String("whole session"),
+                           getLocalBounds().reduced(2), juce::Justification::topLeft, false);
+            }
+
+            void mouseWheelMove(const MouseEvent& event, const MouseWheelDetails& wheel) override
+            {
+                if (model.timeline.isEmpty() || getWidth() <= 0) { return; }
+
+                double from, to;
+                visibleRange(from, to);
+                double anchor = from + (to - from) * event.x / getWidth();
+                double zoom = wheel.deltaY > 0 ? 0.8 : 1.25;
+                double span = juce::jmax(double(MidiDiffScoreTimeline::sliceMillis) * 4, (to - from) * zoom);
+                setVisibleRange(anchor - (anchor - from) * span / (to - from), span);
+            }
+
+            void mouseDown(const MouseEvent& event) override
+            {
+                dragStartX = event.x;
+                visibleRange(dragStartFrom, dragStartTo);
+            }
+
+            void mouseDrag(const MouseEvent& event) override
+            {
+                if (! isZoomed() || getWidth() <= 0) { return; }
+
+                double span = dragStartTo - dragStartFrom;
+                setVisibleRange(dragStartFrom - (event.x - dragStartX) * span / getWidth(), span);
+            }
+
+            void mouseDoubleClick(const MouseEvent&) override
+            {
+                viewSpan = 0.0;
+                repaint();
+            }
+
+        private:
+            bool isZoomed() const {
+                return viewSpan > 0.0;
+            }
+
+            void visibleRange(double& from, double& to) const {
+                auto& timeline = model.timeline;
+                if (isZoomed()) {
+                    from = viewFrom;
+                    to = viewFrom + viewSpan;
+                }
+                else {
+                    from = double(timeline.getStartMillis());
+                    to = juce::jmax(from + MidiDiffScoreTimeline::sliceMillis, double(timeline.getEndMillis()));
+                }
+            }
+
+            void setVisibleRange(double from, double span) {
+                auto& timeline = model.timeline;
+                double sessionFrom = double(timeline.getStartMillis());
+                double sessionSpan = double(timeline.getEndMillis()) - sessionFrom;
+                if (span >= sessionSpan) {
+                    viewSpan = 0.0;
+                }
+                else {
+                    viewSpan = span;
+                    viewFrom = juce::jlimit(sessionFrom, sessionFrom + sessionSpan - span, from);
+                }
+                repaint();
+            }
+
+            MidiDiffModel& model;
+            double viewFrom = 0.0;
+            double viewSpan = 0.0;  // 0 shows the whole session
+            int dragStartX = 0;
+            double dragStartFrom = 0.0, dragStartTo = 0.0;
+        };
+
+        ScoreTimelineView scoreTimelineView;
+
+        juce::ToggleButton loopPracticeToggle{ "Loop Passes" };
+        juce::Label loopPassesText{ {}, "-" };
+
+        // "Current" (id 1) and the completed takes (id take id + 2) with their percentage at the threshold
+        juce::Label takesLabel{ {}, "Takes" };
+        juce::ComboBox takeSelector;
+        juce::Label bestTakeText{ {}, "-" };
+        uint64_t listedGeneration = 0;
+        int listedThreshold = -1;
+
+        juce::Label takeMemoryLabel{ {}, "Take Memory" };
+        juce::ComboBox takeMemorySelector;
+
+        juce::Label feedbackLabel{ {}, "Hit/Miss MIDI" };
+        juce::ComboBox feedbackSelector;
+        juce::ComboBox feedbackChannelSelector;
+
+        // channels seen since the previous timer tick, and the note-ons over the block budget
+        juce::String channelActivityText;
+
         //operations
         void setData(MidiDiffResult result) {
             performanceText
                 .setText(juce::String(result.getPerformance()) + "%", juce::dontSendNotification);
             lastUsedMidiChannelText
-                .setText(juce::String(result.getLastUsedMidiChannel()), juce::dontSendNotification);
+                .setText(juce::String(result.getLastUsedMidiChannel()) + channelActivityText, juce::dontSendNotification);
             inThresholdText
                 .setText(juce::String(result.getInThreshold() + "%"), juce::dontSendNotification);
         }
 
         void buttonClicked(juce::Button* button) override
         {
-            owner.model.resetMidiCounters();
+            owner.model.startNewTake();
+        }
+
+        // result of the selected take, or of the current one
+        MidiDiffResult shownResult() {
+            auto& take = thresholdCurve.take;
+            return take ? owner.model.takeResultAt(*take, owner.model.threshold) : owner.model.resultAt(owner.model.threshold);
+        }
+
+        juce::String takeName(const MidiDiffTake& take) {
+            return "#" + juce::String(int(take.getId()) + 1);
+        }
+
+        // refills the take list when the kept takes or the threshold changed, keeping the selection
+        void updateTakes() {
+            auto& model = owner.model;
+            auto& takes = model.takes;
+            auto threshold = model.threshold.load();
+            if (takes.getGeneration() == listedGeneration && threshold == listedThreshold) { return; }
+            listedGeneration = takes.getGeneration();
+            listedThreshold = threshold;
+
+            auto selected = thresholdCurve.take;
+            thresholdCurve.take = nullptr;
+            takeSelector.clear(juce::dontSendNotification);
+            takeSelector.addItem("Current", 1);
+            int selectedId = 1;
+            for (size_t i = 0; i < takes.size(); i++) {
+                auto& take = takes[i];
+                auto score = model.isStale(*take) ? juce::String("...") : juce::String(int(take->getScoreCurve().percentageAt(threshold))) + "%";
+                takeSelector.addItem(takeName(*take) + "  " + score, itemId(*take));
+                if (selected && take->getId() == selected->getId()) {
+                    thresholdCurve.take = take;
+                    selectedId = itemId(*take);
+                }
+            }
+            takeSelector.setSelectedId(selectedId, juce::dontSendNotification);
+
+            auto stale = model.countStaleTakes();
+            auto best = takes.bestTake(threshold, model.alignmentMode);
+            if (stale > 0) {
+                bestTakeText.setText("rescoring " + juce::String(stale), juce::dontSendNotification);
+            }
+            else if (best < 0) {
+                bestTakeText.setText("-", juce::dontSendNotification);
+            }
+            else {
+                auto percentage = int(takes[size_t(best)]->getScoreCurve().percentageAt(threshold));
+                bestTakeText.setText("best " + takeName(*takes[size_t(best)]) + " " + juce::String(percentage) + "%", juce::dontSendNotification);
+            }
+        }
+
+        static int itemId(const MidiDiffTake& take) {
+            return int(take.getId()) + 2;
+        }
+
+        // the selected take is rescored right away if the alignment changed since it was scored
+        void selectTake(int id) {
+            auto& model = owner.model;
+            auto index = id >= 2 ? model.takes.indexOf(uint32_t(id - 2)) : -1;
+            if (index >= 0 && model.isStale(*model.takes[size_t(index)])) {
+                model.realignTake(size_t(index));
+            }
+            thresholdCurve.take = index >= 0 ? model.takes[size_t(index)] : nullptr;
+            updateTakes();
+            setData(shownResult());
+            thresholdCurve.repaint();
         }
 
         void initLabel(juce::Label& label) {
@@ -262,9 +835,11 @@ private:
 
         explicit Editor (MidiDiffPluginProcessor& ownerIn)
             : AudioProcessorEditor (ownerIn),
+              thresholdCurve (ownerIn.model),
+              scoreTimelineView (ownerIn.model),
               owner (ownerIn)
         {
-            setSize(19 * s, 13 * s);
+            setSize(19 * s, 33 * s);
 
             addAndMakeVisible(lastUsedMidiChannelLabel);
             initLabel(lastUsedMidiChannelLabel);
@@ -285,6 +860,15 @@ private:
             initLabel(inThresholdText);
             inThresholdText.setJustificationType(juce::Justification::centredRight);
 
+            addAndMakeVisible(feedLabel);
+            initLabel(feedLabel);
+            addAndMakeVisible(feedText);
+            initLabel(feedText);
+            feedText.setJustificationType(juce::Justification::centredRight);
+            if (owner.feed.isOpen()) {
+                feedText.setText(owner.feed.getName(), juce::dontSendNotification);
+            }
+
             //controlMidiChannel
             addAndMakeVisible(controlMidiChannelLabel);
             initLabel(controlMidiChannelLabel);
@@ -306,14 +890,85 @@ private:
             //thresholdMidiChannel
             addAndMakeVisible(thresholdLabel);
             initLabel(thresholdLabel);
-            addAndMakeVisible(thresholdSelector);
-            thresholdSelector.addItem(std::to_string(100), 1);
-            thresholdSelector.addItem(std::to_string(200), 2);
-            thresholdSelector.addItem(std::to_string(500), 3);
-            thresholdSelector.addItem(std::to_string(1000), 4);
-            thresholdSelector.setSelectedId(2);
-            thresholdSelector.onChange = [this] {
-                owner.model.threshold = thresholdSelector.getText().getIntValue();
+            addAndMakeVisible(thresholdSlider);
+            thresholdSlider.setSliderStyle(juce::Slider::LinearBar);
+            thresholdSlider.setRange(MidiDiffModel::minThreshold, MidiDiffModel::maxThreshold, 1);
+            thresholdSlider.setSkewFactorFromMidPoint(200);
+            thresholdSlider.setTextValueSuffix(" ms");
+            thresholdSlider.setValue(owner.model.threshold, juce::dontSendNotification);
+            thresholdSlider.onValueChange = [this] {
+                owner.model.threshold = int(thresholdSlider.getValue());
+                updateTakes();
+                setData(shownResult());
+                thresholdCurve.repaint();
+            };
+
+            addAndMakeVisible(thresholdCurve);
+            addAndMakeVisible(scoreTimelineView);
+
+            //loop practice
+            addAndMakeVisible(loopPracticeToggle);
+            loopPracticeToggle.setToggleState(owner.model.loopPracticeEnabled, juce::dontSendNotification);
+            loopPracticeToggle.onClick = [this] {
+                owner.model.loopPracticeEnabled = loopPracticeToggle.getToggleState();
+            };
+            addAndMakeVisible(loopPassesText);
+            initLabel(loopPassesText);
+            loopPassesText.setJustificationType(juce::Justification::centredRight);
+
+            //alignment
+            addAndMakeVisible(alignmentLabel);
+            initLabel(alignmentLabel);
+            addAndMakeVisible(alignmentSelector);
+            alignmentSelector.addItem("Nearest note", MidiDiffModel::nearestAlignment);
+            alignmentSelector.addItem("Time warped (rubato)", MidiDiffModel::warpedAlignment);
+            alignmentSelector.setSelectedId(owner.model.alignmentMode);
+            alignmentSelector.onChange = [this] {
+                owner.model.alignmentMode = alignmentSelector.getSelectedId();
+                // the kept takes are rescored by the timer, a few at a time, and the shown one at once
+                listedThreshold = -1;
+                selectTake(takeSelector.getSelectedId());
+            };
+
+            //takes
+            addAndMakeVisible(takesLabel);
+            initLabel(takesLabel);
+            addAndMakeVisible(takeSelector);
+            takeSelector.onChange = [this] {
+                selectTake(takeSelector.getSelectedId());
+            };
+            addAndMakeVisible(bestTakeText);
+            initLabel(bestTakeText);
+            bestTakeText.setJustificationType(juce::Justification::centredRight);
+            updateTakes();
+
+            addAndMakeVisible(takeMemoryLabel);
+            initLabel(takeMemoryLabel);
+            addAndMakeVisible(takeMemorySelector);
+            for (int megabytes : { 8, 32, 128, 512 }) {
+                takeMemorySelector.addItem(juce::String(megabytes) + " MB", megabytes);
+            }
+            takeMemorySelector.setSelectedId(int(owner.model.takes.getMemoryCap() / (1024 * 1024)), juce::dontSendNotification);
+            takeMemorySelector.onChange = [this] {
+                owner.model.takes.setMemoryCap(size_t(takeMemorySelector.getSelectedId()) * 1024 * 1024, owner.model.threshold, owner.model.alignmentMode);
+                updateTakes();
+            };
+
+            //feedback
+            addAndMakeVisible(feedbackLabel);
+            initLabel(feedbackLabel);
+            addAndMakeVisible(feedbackSelector);
+            feedbackSelector.addItem("Off", MidiDiffModel::feedbackOff);
+            feedbackSelector.addItem("Notes", MidiDiffModel::feedbackNotes);
+            feedbackSelector.addItem("CC", MidiDiffModel::feedbackControllers);
+            feedbackSelector.setSelectedId(owner.model.feedbackMode);
+            feedbackSelector.onChange = [this] {
+                owner.model.feedbackMode = feedbackSelector.getSelectedId();
+            };
+            addAndMakeVisible(feedbackChannelSelector);
+            initChannels(feedbackChannelSelector, owner.model.feedbackChannel);
+            feedbackChannelSelector.onChange = [this] {
+                owner.model.feedbackChannel = feedbackChannelSelector.getText().getIntValue();
             };
 
             addAndMakeVisible(percentageButton);
@@ -336,7 +991,7 @@ private:
 
             controlMidiChannelSelector.setBounds(column(1), row(2), width(2), height(1));
             performanceMidiChannelSelector.setBounds(column(3), row(2), width(2), height(1));
-            thresholdSelector.setBounds(column(5), row(2), width(2), height(1));
+            thresholdSlider.setBounds(column(5), row(2), width(2), height(1));
 
             percentageButton.setBounds(column(1), row(3), width(6), height(1));
 
@@ -348,11 +1003,71 @@ private:
 
             inThresholdLabel.setBounds(column(1), row(6), width(2), height(1));
             inThresholdText.setBounds(column(3), row(6), width(4), height(1));
+
+            feedLabel.setBounds(column(1), row(7), width(2), height(1));
+            feedText.setBounds(column(3), row(7), width(4), height(1));
+
+            alignmentLabel.setBounds(column(1), row(8), width(2), height(1));
+            alignmentSelector.setBounds(column(3), row(8), width(4), height(1));
+
+            feedbackLabel.setBounds(column(1), row(9), width(2), height(1));
+            feedbackSelector.setBounds(column(3), row(9), width(2), height(1));
+            feedbackChannelSelector.setBounds(column(5), row(9), width(2), height(1));
+
+            thresholdCurve.setBounds(column(1), row(10), width(6), height(2));
+
+            loopPracticeToggle.setBounds(column(1), row(12), width(2), height(1));
+            loopPassesText.setBounds(column(3), row(12), width(4), height(1));
+
+            scoreTimelineView.setBounds(column(1), row(13), width(6), height(2));
+
+            takesLabel.setBounds(column(1), row(15), width(2), height(1));
+            takeSelector.setBounds(column(3), row(15), width(2), height(1));
+            bestTakeText.setBounds(column(5), row(15), width(2), height(1));
+
+            takeMemoryLabel.setBounds(column(1), row(16), width(2), height(1));
+            takeMemorySelector.setBounds(column(3), row(16), width(2), height(1));
         }
 
         void timerCallback() override
         {
-            setData(owner.model.calculateResult());
+            updateChannelActivity(owner.model.takeChannelActivity());
+            updateTakes();
+            setData(shownResult());
+            thresholdCurve.repaint();
+            scoreTimelineView.repaint();
+            updateLoopPasses();
+        }
+
+        // the last few pass scores, newest first
+        void updateLoopPasses() {
+            if (! owner.model.loopPracticeEnabled) {
+                loopPassesText.setText("-", juce::dontSendNotification);
+                return;
+            }
+
+            MidiDiffLoopPractice::PassScore scores[4];
+            auto count = owner.model.loopPasses.getHistory(scores, 4);
+            juce::String text;
+            for (int i = count - 1; i >= 0; i--) {
+                text += "#" + juce::String(scores[i].pass) + " " + juce::String(scores[i].percentage) + "%  ";
+            }
+            loopPassesText.setText(count > 0 ? text : juce::String("waiting for a whole pass"), juce::dontSendNotification);
+        }
+
+        void updateChannelActivity(uint16_t activity) {
+            juce::String active;
+            for (int channel = 1; channel <= 16; channel++) {
+                if (activity & (1 << (channel - 1))) {
+                    active += (active.isEmpty() ? "" : ",") + juce::String(channel);
+                }
+            }
+            channelActivityText = active.isEmpty() ? juce::String() : " (" + active + ")";
+
+            auto dropped = owner.model.droppedNoteOns.load();
+            if (dropped > 0) {
+                channelActivityText += " " + juce::String((juce::int64) dropped) + " dropped";
+            }
         }
     private:
         int row(int rowIdx) {
@@ -373,7 +1088,7 @@ private:
 
         void valueChanged (Value&) override
         {
-            setData(owner.model.calculateResult());
+            setData(shownResult());
         }
 
         MidiDiffPluginProcessor& owner;
@@ -387,35 +1102,242 @@ private:
 
         long epoch = long(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
         auto rate = getSampleRate();
+        auto numSamples = audio.getNumSamples();
+
+        liveMatcher.beginBlock(samplesProcessed, numSamples, model.threshold);
+        auto trackLoop = updateLoopPass(numSamples);
+
+        // Only the status byte is looked at until a note-on on one of the two channels turns up,
+        // so controller, pitch-bend, aftertouch and SysEx floods cost a few instructions each.
+        int noteOnCount = 0;
+        int lastChannel = 0;
+        uint16 activeChannels = 0;
+        auto referenceChannel = model.midiChannelReference.load();
+        auto performanceChannel = model.midiChannelPerformance.load();
 
-        for (const auto midiMessage : midi) {
-            auto message = midiMessage.getMessage();
-            auto isNoteOn = message.isNoteOn();
-            auto channel = message.getChannel();
-            auto isReferenceChannel = channel == model.midiChannelReference;
-            auto isPerformanceChannel = channel == model.midiChannelPerformance;
-            model.lastUsedMidiChannel = channel;
+        for (const auto metadata : midi) {
+            if (metadata.numBytes < 1) { continue; }
+            auto status = metadata.data[0];
+            if (status >= 0xf0) { continue; }
+
+            auto channel = (status & 0x0f) + 1;
+            activeChannels |= uint16(1 << (channel - 1));
+            lastChannel = channel;
+
+            auto isNoteOn = (status & 0xf0) == 0x90 && metadata.numBytes >= 3 && metadata.data[2] != 0;
+            auto isReferenceChannel = channel == referenceChannel;
+            auto isPerformanceChannel = channel == performanceChannel;
 
             if (isNoteOn && (isReferenceChannel || isPerformanceChannel))
             {
-                long messageTimestamp = toLong(message.getTimeStamp());
-                int noteNumber = message.getNoteNumber();
+                if (noteOnCount == MidiDiffModel::noteOnBudgetPerBlock) {
+                    model.droppedNoteOns++;
+                    continue;
+                }
+                noteOnCount++;
+
+                long messageTimestamp = toLong(metadata.samplePosition);
+                int noteNumber = metadata.data[1];
                 long messageTimestampSec = toLong(messageTimestamp / rate);
                 long midiEventTimestamp = currentBufferEventTimeStartEpochMillis + (messageTimestampSec / 1000);
 
-                if (isReferenceChannel) {
-                    model.controlMidiEvents.push_back(make_tuple(midiEventTimestamp, noteNumber));
+                if (trackLoop && loopWrapOffset >= 0 && metadata.samplePosition >= loopWrapOffset) {
+                    wrapLoopPass();
                 }
-                else if (isPerformanceChannel) {
-                    model.performanceMidiEvents.push_back(make_tuple(midiEventTimestamp, noteNumber));
+
+                // Once the loop passes hold their reference, later passes are only scored per pass: the
+                // take keeps the first whole pass, so it never warps one reference onto many passes.
+                auto repeatsLoopPass = trackLoop && model.loopPasses.hasReference();
+                if (! repeatsLoopPass) {
+                    model.recordNote(midiEventTimestamp, noteNumber, isReferenceChannel);
+                }
+                liveMatcher.noteOn(metadata.samplePosition, noteNumber, isReferenceChannel);
+
+                if (trackLoop) {
+                    auto passMillis = (transportSample - passStartSample + metadata.samplePosition) * 1000.0 / rate;
+                    model.loopPasses.noteOn(passMillis, noteNumber, isReferenceChannel);
                 }
             }
         }
 
+        if (lastChannel != 0) {
+            model.lastUsedMidiChannel = lastChannel;
+            model.channelActivity.fetch_or(activeChannels, std::memory_order_relaxed);
+        }
+
+        if (trackLoop && loopWrapOffset >= 0) {
+            wrapLoopPass();
+        }
+
+        liveMatcher.endBlock();
+        addFeedbackMidi(midi, numSamples);
+        samplesProcessed += numSamples;
+
         long end = long(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
         currentBufferEventTimeStartEpochMillis = epoch;
     }
 
+    // Follows the host transport for loop practice. A new pass starts whenever playback starts
+    // or the position jumps; it is whole when it starts at the loop start (or, if the host does
+    // not report loop points, when it starts with a backwards jump), and the previous pass is
+    // complete when it ended with a backwards jump. Hosts that do not split blocks at the loop
+    // end wrap inside a block: with loop points and tempo known, loopWrapOffset is set to the
+    // sample where the pass ends, and the jump reported by the next block only re-anchors the
+    // pass started there. Returns whether notes should be tracked.
+    bool updateLoopPass (int numSamples)
+    {
+        loopWrapOffset = -1;
+
+        auto epoch = model.takeEpoch.load (std::memory_order_relaxed);
+        if (epoch != loopEpoch || model.loopPracticeEnabled != loopPracticeActive)
+        {
+            model.loopPasses.reset();
+            loopPracticeActive = model.loopPracticeEnabled;
+            loopEpoch = epoch;
+            wasPlaying = false;
+        }
+
+        if (! loopPracticeActive)
+            return false;
+
+        Optional<AudioPlayHead::PositionInfo> position;
+        if (auto* playHead = getPlayHead())
+            position = playHead->getPosition();
+
+        auto playing = position.hasValue() && position->getIsPlaying();
+        if (! playing)
+        {
+            wasPlaying = false;
+            return false;
+        }
+
+        auto timeInSamples = position->getTimeInSamples();
+        transportSample = timeInSamples.hasValue() ? *timeInSamples : expectedSample;
+
+        auto ppq = position->getPpqPosition();
+        auto bpm = position->getBpm();
+        auto loopPoints = position->getLoopPoints();
+        auto knowsLoopStart = position->getIsLooping() && ppq.hasValue() && loopPoints.hasValue();
+        auto atLoopStart = knowsLoopStart && std::abs (*ppq - loopPoints->ppqStart) < 0.05;
+
+        if (! wasPlaying || transportSample != expectedSample)
+        {
+            auto wrapped = wasPlaying && transportSample < expectedSample;
+
+            if (wrappedEarly && wrapped && knowsLoopStart)
+            {
+                // the host caught up with the wrap already made inside the previous block
+                passStartSample = transportSample - (expectedSample - passStartSample);
+            }
+            else
+            {
+                auto startsWhole = knowsLoopStart ? atLoopStart : wrapped;
+                model.loopPasses.startPass (wrapped, startsWhole, model.threshold);
+                passStartSample = transportSample;
+            }
+        }
+        wrappedEarly = false;
+
+        // loop end within this block, when the host does not split blocks there
+        if (knowsLoopStart && bpm.hasValue() && *bpm > 0.0)
+        {
+            auto loopEnd = (loopPoints->ppqEnd - *ppq) * 60.0 / *bpm * getSampleRate();
+            if (loopEnd >= 0.0 && loopEnd < numSamples)
+                loopWrapOffset = int (loopEnd);
+        }
+
+        expectedSample = transportSample + numSamples;
+        wasPlaying = true;
+        return true;
+    }
+
+    // ends the current pass at loopWrapOffset, the notes after it belong to the next pass
+    void wrapLoopPass()
+    {
+        model.loopPasses.startPass (true, true, model.threshold);
+        passStartSample = transportSample + loopWrapOffset;
+        loopWrapOffset = -1;
+        wrappedEarly = true;
+    }
+
+    // Turns the hits and misses of this block into MIDI. Feedback notes last feedbackNoteLength
+    // samples, their note-offs are carried over into the next blocks when needed, with the channel
+    // and number of their note-on. The events are collected in feedbackMidi, which is reserved in
+    // prepareToPlay(), and added to the host's buffer in one step; that may still allocate if the
+    // host's buffer has no room left for them.
+    void addFeedbackMidi (MidiBuffer& midi, int numSamples)
+    {
+        auto mode = model.feedbackMode.load();
+        auto channel = model.feedbackChannel.load();
+        auto hitNumber = model.feedbackHitNumber.load();
+        auto missNumber = model.feedbackMissNumber.load();
+        auto value = model.feedbackValue.load();
+        feedbackMidi.clear();
+
+        for (int i = 0; i < liveMatcher.getNumFeedback(); i++)
+        {
+            auto& feedback = liveMatcher.getFeedback (i);
+            auto number = feedback.hit ? hitNumber : missNumber;
+
+            if (mode == MidiDiffModel::feedbackControllers)
+            {
+                feedbackMidi.addEvent (MidiMessage::controllerEvent (channel, number, value), feedback.sampleOffset);
+            }
+            else if (mode == MidiDiffModel::feedbackNotes)
+            {
+                auto& noteOff = feedbackNoteOff[feedback.hit ? 0 : 1];
+                if (noteOff.offset >= 0)
+                    feedbackMidi.addEvent (MidiMessage::noteOff (noteOff.channel, noteOff.number), jmin (noteOff.offset, feedback.sampleOffset));
+
+                feedbackMidi.addEvent (MidiMessage::noteOn (channel, number, (uint8) value), feedback.sampleOffset);
+                noteOff = { feedback.sampleOffset + feedbackNoteLength, channel, number };
+            }
+        }
+
+        for (auto& noteOff : feedbackNoteOff)
+        {
+            if (noteOff.offset < 0)
+                continue;
+
+            if (noteOff.offset < numSamples)
+            {
+                feedbackMidi.addEvent (MidiMessage::noteOff (noteOff.channel, noteOff.number), noteOff.offset);
+                noteOff.offset = -1;
+            }
+            else
+            {
+                noteOff.offset -= numSamples;
+            }
+        }
+
+        if (! feedbackMidi.isEmpty())
+            midi.addEvents (feedbackMidi, 0, numSamples, 0);
+    }
+
+   #if JUCE_UNIT_TESTS
+    // The Debug configurations enable JUCE_UNIT_TESTS: the first instance of a process runs the
+    // "MidiDiff" tests on a background thread. A failing expectation asserts (stopping in the
+    // debugger) and every result is written to the debug log.
+    static void runUnitTestsOnce()
+    {
+        static std::atomic<bool> started { false };
+        if (started.exchange (true))
+            return;
+
+        Thread::launch ([]
+        {
+            UnitTestRunner runner;
+            runner.runTestsInCategory ("MidiDiff");
+
+            int failures = 0;
+            for (int i = 0; i < runner.getNumResults(); i++)
+                failures += runner.getResult (i)->failures;
+
+            DBG ("MidiDiff unit tests: " << runner.getNumResults() << " tests, " << failures << " failures");
+        });
+    }
+   #endif
+
     static BusesProperties getBusesLayout()
     {
         // Live and Cakewalk don't like to load midi-only plugins, so we add an audio output there.
@@ -427,6 +1349,35 @@ private:
 
     ValueTree state { "state" };
     MidiDiffModel model;
+    MidiDiffFeedWriter feed;
+    MidiDiffFeedMatch recentFeedMatches[MidiDiffFeedSnapshot::matchCapacity];
+    static constexpr int rescoreEveryTicks = 4;
+    int timerTicks = 0;
+
+    // audio thread only
+    MidiDiffLiveMatcher liveMatcher;
+    int64 samplesProcessed = 0;
+    int feedbackNoteLength = 2205;
+    // pending hit/miss note-off, offset relative to the block, -1 when none
+    struct FeedbackNoteOff
+    {
+        int offset = -1;
+        int channel = 1;
+        int number = 0;
+    };
+    FeedbackNoteOff feedbackNoteOff[2];
+    // room for the feedback of a full block: a note-on and a note-off per result and the two carried note-offs,
+    // at most 16 bytes per event
+    static constexpr int feedbackMidiBytes = (MidiDiffLiveMatcher::maxFeedbackPerBlock * 2 + 2) * 16;
+    MidiBuffer feedbackMidi;
+    bool loopPracticeActive = false;
+    uint32 loopEpoch = 0;
+    bool wasPlaying = false;
+    int64 transportSample = 0;
+    int64 expectedSample = 0;
+    int64 passStartSample = 0;
+    int loopWrapOffset = -1;  // sample of this block where the loop ends, -1 if it does not end in it
+    bool wrappedEarly = false;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiDiffPluginProcessor)
 };
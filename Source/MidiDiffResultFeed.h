@@ -0,0 +1,287 @@
+/*
+  ==============================================================================
+
+    Live result feed: every plugin instance publishes its current score and its
+    most recent matches into a named POSIX shared-memory segment, so that a
+    separate local process (e.g. a wall display) can poll many instances.
+
+    The segment is guarded by a seqlock. The writer never waits for a reader and
+    publishing is plain memory writes (no syscalls); the segment is created once
+    when the plugin is constructed. Readers map it read-only, so they can neither
+    block nor corrupt the writer, and they retry a bounded number of times when
+    they catch a publish half way through.
+
+    Segment names are "/mididiff.<pid>.<instance>". On Linux they are visible in
+    /dev/shm, which MidiDiffFeedReader::listFeeds() scans. A segment outlives a
+    host that crashed; listFeeds() unlinks the segments whose process is gone.
+    A feed that is still listed but whose publishedAtMillis stopped advancing
+    belongs to a host that hangs (it is republished a few times per second).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#if ! defined (_WIN32)
+ #include <cerrno>
+ #include <csignal>
+ #include <cstdlib>
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+ #if defined (__linux__)
+  #include <dirent.h>
+ #endif
+#endif
+
+struct MidiDiffFeedMatch
+{
+    int64_t timeMillis;
+    int32_t note;
+    int32_t distance;
+};
+
+struct MidiDiffFeedSnapshot
+{
+    int32_t percentage;
+    int32_t inThreshold;
+    int32_t lastUsedMidiChannel;
+    int32_t threshold;
+    int32_t midiChannelReference;
+    int32_t midiChannelPerformance;
+    int64_t publishedAtMillis;
+    // when the score was last computed, the feed republishes it until the next rescore
+    int64_t scoredAtMillis;
+    uint64_t publishCount;
+
+    // Total number of settled matches ever written, across takes; the ring slot of match i is
+    // i % matchCapacity. A match is published once it settled and keeps its number and value,
+    // so matchCount can be used as a cursor for new matches.
+    uint64_t matchCount;
+    static constexpr uint32_t matchCapacity = 64;
+    MidiDiffFeedMatch matches[matchCapacity];
+};
+
+struct MidiDiffFeedLayout
+{
+    static constexpr uint32_t magicNumber = 0x4d444946; // "MDIF"
+    static constexpr uint32_t currentVersion = 3;
+
+    uint32_t magic;
+    uint32_t version;
+    char name[32];
+
+    // odd while the writer is inside publish()
+    alignas (64) std::atomic<uint32_t> sequence;
+    alignas (64) MidiDiffFeedSnapshot snapshot;
+};
+
+static_assert (std::atomic<uint32_t>::is_always_lock_free, "the feed seqlock must be lock-free to live in shared memory");
+
+
+class MidiDiffFeedWriter
+{
+public:
+    MidiDiffFeedWriter() {
+        static std::atomic<int> instanceCounter { 0 };
+        this->name = "/mididiff." + std::to_string(currentProcessId()) + "." + std::to_string(instanceCounter++);
+        open();
+    }
+
+    ~MidiDiffFeedWriter() {
+        close();
+    }
+
+    bool isOpen() const {
+        return layout != nullptr;
+    }
+
+    const std::string& getName() const {
+        return name;
+    }
+
+    // Single writer only. Never blocks, never allocates, never enters the kernel.
+    void publish(const MidiDiffFeedSnapshot& values, const MidiDiffFeedMatch* recent, uint64_t recentCount, uint64_t firstIndex) {
+        if (layout == nullptr) { return; }
+
+        auto seq = layout->sequence.load(std::memory_order_relaxed);
+        layout->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto& target = layout->snapshot;
+        target.percentage = values.percentage;
+        target.inThreshold = values.inThreshold;
+        target.lastUsedMidiChannel = values.lastUsedMidiChannel;
+        target.threshold = values.threshold;
+        target.midiChannelReference = values.midiChannelReference;
+        target.midiChannelPerformance = values.midiChannelPerformance;
+        target.publishedAtMillis = values.publishedAtMillis;
+        target.scoredAtMillis = values.scoredAtMillis;
+        target.publishCount++;
+
+        if (recentCount > MidiDiffFeedSnapshot::matchCapacity) {
+            firstIndex += recentCount - MidiDiffFeedSnapshot::matchCapacity;
+            recent += recentCount - MidiDiffFeedSnapshot::matchCapacity;
+            recentCount = MidiDiffFeedSnapshot::matchCapacity;
+        }
+        for (uint64_t i = 0; i < recentCount; i++) {
+            target.matches[(firstIndex + i) % MidiDiffFeedSnapshot::matchCapacity] = recent[i];
+        }
+        target.matchCount = firstIndex + recentCount;
+
+        layout->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+    void open() {
+       #if ! defined (_WIN32)
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) { return; }
+
+        if (ftruncate(fd, sizeof(MidiDiffFeedLayout)) == 0) {
+            void* mapped = mmap(nullptr, sizeof(MidiDiffFeedLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) {
+                // ftruncate zero-fills the segment, only the identification needs writing
+                layout = new (mapped) MidiDiffFeedLayout();
+                std::strncpy(layout->name, name.c_str(), sizeof(layout->name) - 1);
+                layout->version = MidiDiffFeedLayout::currentVersion;
+                std::atomic_thread_fence(std::memory_order_release);
+                layout->magic = MidiDiffFeedLayout::magicNumber;
+            }
+        }
+        ::close(fd);
+
+        if (layout == nullptr) { shm_unlink(name.c_str()); }
+       #endif
+    }
+
+    void close() {
+       #if ! defined (_WIN32)
+        if (layout == nullptr) { return; }
+        munmap(layout, sizeof(MidiDiffFeedLayout));
+        shm_unlink(name.c_str());
+        layout = nullptr;
+       #endif
+    }
+
+    static long currentProcessId() {
+       #if ! defined (_WIN32)
+        return long(getpid());
+       #else
+        return 0;
+       #endif
+    }
+
+    std::string name;
+    MidiDiffFeedLayout* layout = nullptr;
+
+    MidiDiffFeedWriter(const MidiDiffFeedWriter&) = delete;
+    MidiDiffFeedWriter& operator=(const MidiDiffFeedWriter&) = delete;
+};
+
+
+// Read side, meant to be used by the dashboard process (it does not depend on JUCE).
+class MidiDiffFeedReader
+{
+public:
+    explicit MidiDiffFeedReader(const std::string& feedName) {
+       #if ! defined (_WIN32)
+        int fd = shm_open(feedName.c_str(), O_RDONLY, 0);
+        if (fd < 0) { return; }
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(MidiDiffFeedLayout)) {
+            void* mapped = mmap(nullptr, sizeof(MidiDiffFeedLayout), PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) {
+                layout = static_cast<const MidiDiffFeedLayout*>(mapped);
+            }
+        }
+        ::close(fd);
+       #endif
+    }
+
+    ~MidiDiffFeedReader() {
+       #if ! defined (_WIN32)
+        if (layout != nullptr) { munmap(const_cast<MidiDiffFeedLayout*>(layout), sizeof(MidiDiffFeedLayout)); }
+       #endif
+    }
+
+    bool isOpen() const {
+        return layout != nullptr
+            && layout->magic == MidiDiffFeedLayout::magicNumber
+            && layout->version == MidiDiffFeedLayout::currentVersion;
+    }
+
+    // Copies a consistent snapshot. Returns false if the writer kept publishing
+    // during every attempt; the caller simply tries again on its next poll.
+    bool read(MidiDiffFeedSnapshot& out, int maxAttempts = 16) const {
+        if (! isOpen()) { return false; }
+
+        for (int attempt = 0; attempt < maxAttempts; attempt++) {
+            auto before = layout->sequence.load(std::memory_order_acquire);
+            if (before & 1) { continue; }
+
+            std::memcpy(&out, &layout->snapshot, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (layout->sequence.load(std::memory_order_relaxed) == before) { return true; }
+        }
+        return false;
+    }
+
+    // Matches of a snapshot in publishing order, oldest first.
+    static std::vector<MidiDiffFeedMatch> recentMatches(const MidiDiffFeedSnapshot& snapshot) {
+        auto count = snapshot.matchCount < MidiDiffFeedSnapshot::matchCapacity ? snapshot.matchCount : uint64_t(MidiDiffFeedSnapshot::matchCapacity);
+        std::vector<MidiDiffFeedMatch> result;
+        result.reserve(size_t(count));
+        for (auto i = snapshot.matchCount - count; i < snapshot.matchCount; i++) {
+            result.push_back(snapshot.matches[i % MidiDiffFeedSnapshot::matchCapacity]);
+        }
+        return result;
+    }
+
+    // Feeds of running processes. Segments left behind by a process that no longer exists are unlinked.
+    static std::vector<std::string> listFeeds() {
+        std::vector<std::string> names;
+       #if defined (__linux__)
+        if (auto* dir = opendir("/dev/shm")) {
+            while (auto* entry = readdir(dir)) {
+                if (std::strncmp(entry->d_name, "mididiff.", 9) != 0) { continue; }
+
+                auto name = std::string("/") + entry->d_name;
+                if (isOrphaned(entry->d_name + 9)) {
+                    shm_unlink(name.c_str());
+                    continue;
+                }
+                names.push_back(name);
+            }
+            closedir(dir);
+        }
+       #endif
+        return names;
+    }
+
+private:
+   #if defined (__linux__)
+    // pidAndInstance is "<pid>.<instance>"
+    static bool isOrphaned(const char* pidAndInstance) {
+        char* end = nullptr;
+        auto pid = std::strtol(pidAndInstance, &end, 10);
+        if (end == pidAndInstance || *end != '.' || pid <= 0) { return false; }
+        return kill(pid_t(pid), 0) != 0 && errno == ESRCH;
+    }
+   #endif
+
+    const MidiDiffFeedLayout* layout = nullptr;
+
+    MidiDiffFeedReader(const MidiDiffFeedReader&) = delete;
+    MidiDiffFeedReader& operator=(const MidiDiffFeedReader&) = delete;
+};
@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    Score of a take as a function of the threshold.
+
+    The per-note distances are sorted once and prefix-summed. For a threshold T
+    a note counts as min(distance, T), so with k = the number of distances
+    below T the sum of all distances is prefix[k] + T * (n - k). Both the
+    percentage and the in-threshold ratio of any threshold are then answered
+    with one binary search, without looking at the notes again.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class MidiDiffScoreCurve
+{
+public:
+    void build(std::vector<int> distances) {
+        std::sort(distances.begin(), distances.end());
+        sortedDistances.swap(distances);
+        prefixSums.assign(1, 0);
+        prefixSums.reserve(sortedDistances.size() + 1);
+        for (auto distance : sortedDistances) {
+            prefixSums.push_back(prefixSums.back() + distance);
+        }
+    }
+
+    size_t size() const {
+        return sortedDistances.size();
+    }
+
+    // number of notes closer than threshold
+    size_t countBelow(int threshold) const {
+        return size_t(std::lower_bound(sortedDistances.begin(), sortedDistances.end(), threshold) - sortedDistances.begin());
+    }
+
+    double inThresholdAt(int threshold) const {
+        if (sortedDistances.empty()) { return 0.0; }
+        return countBelow(threshold) * 100.0 / sortedDistances.size();
+    }
+
+    double percentageAt(int threshold) const {
+        if (sortedDistances.empty() || threshold <= 0) { return 0.0; }
+        auto below = countBelow(threshold);
+        double sumOfDistances = double(prefixSums[below]) + double(threshold) * (sortedDistances.size() - below);
+        double averageDistance = sumOfDistances / sortedDistances.size();
+        return 100.0 - averageDistance * 100.0 / threshold;
+    }
+
+private:
+    std::vector<int> sortedDistances;
+    std::vector<int64_t> prefixSums;
+};
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    Multi-resolution history of a session.
+
+    Settled matches are added to fixed time slices (sliceMillis each). Every
+    level above the slices sums pairs of buckets of the level below, so level k
+    holds buckets of 2^k slices. Adding a match updates one bucket per level,
+    and the totals of any time range come from at most two buckets per level,
+    so drawing a zoomed view costs O(pixels), whatever the length of the
+    session.
+
+    A match is added once, with the distance and hit it had at the time, and is
+    never updated afterwards.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class MidiDiffScoreTimeline
+{
+public:
+    static constexpr long sliceMillis = 250;
+
+    struct Aggregate
+    {
+        int64_t sumOfDistances = 0;
+        int32_t hits = 0;
+        int32_t notes = 0;
+
+        void add(const Aggregate& other) {
+            sumOfDistances += other.sumOfDistances;
+            hits += other.hits;
+            notes += other.notes;
+        }
+    };
+
+    void clear() {
+        levels.clear();
+        startMillis = 0;
+    }
+
+    bool isEmpty() const {
+        return levels.empty();
+    }
+
+    long getStartMillis() const {
+        return startMillis;
+    }
+
+    long getEndMillis() const {
+        return levels.empty() ? startMillis : startMillis + long(levels[0].size()) * sliceMillis;
+    }
+
+    // The first match fixes the start of the timeline, earlier ones go into the first slice.
+    void add(long timeMillis, int distance, bool hit) {
+        if (levels.empty()) {
+            startMillis = timeMillis;
+            levels.emplace_back();
+        }
+
+        size_t slice = timeMillis > startMillis ? size_t((timeMillis - startMillis) / sliceMillis) : 0;
+        while ((size_t(1) << (levels.size() - 1)) <= slice) {
+            addLevel();
+        }
+
+        Aggregate match;
+        match.sumOfDistances = distance;
+        match.hits = hit ? 1 : 0;
+        match.notes = 1;
+        for (size_t level = 0; level < levels.size(); level++) {
+            auto bucket = slice >> level;
+            if (levels[level].size() <= bucket) { levels[level].resize(bucket + 1); }
+            levels[level][bucket].add(match);
+        }
+    }
+
+    // Totals of the slices overlapping [fromMillis, toMillis), summed from the largest
+    // aligned buckets that fit, at most two per level.
+    Aggregate query(long fromMillis, long toMillis) const {
+        Aggregate total;
+        if (levels.empty() || toMillis <= startMillis) { return total; }
+
+        long sliceCount = long(levels[0].size());
+        long from = fromMillis > startMillis ? (fromMillis - startMillis) / sliceMillis : 0;
+        long to = (toMillis - startMillis + sliceMillis - 1) / sliceMillis;
+        if (to > sliceCount) { to = sliceCount; }
+
+        while (from < to) {
+            size_t level = 0;
+            while (level + 1 < levels.size()
+                   && (from & ((1L << (level + 1)) - 1)) == 0
+                   && from + (1L << (level + 1)) <= to) {
+                level++;
+            }
+            total.add(levels[level][size_t(from >> level)]);
+            from += 1L << level;
+        }
+        return total;
+    }
+
+private:
+    void addLevel() {
+        auto& below = levels.back();
+        std::vector<Aggregate> level((below.size() + 1) / 2);
+        for (size_t i = 0; i < below.size(); i++) {
+            level[i / 2].add(below[i]);
+        }
+        levels.push_back(std::move(level));
+    }
+
+    // levels[k][i] sums the slices [i * 2^k, (i + 1) * 2^k)
+    std::vector< std::vector<Aggregate> > levels;
+    long startMillis = 0;
+};
@@ -0,0 +1,205 @@
+/*
+  ==============================================================================
+
+    Completed takes.
+
+    A take is sealed when a new one is started. It keeps its notes compactly
+    (time relative to the take start and pitch, sorted by time) and the score
+    curve of its distances, so its result at any threshold is one binary
+    search away, and comparing takes or picking the best one needs no
+    rescoring. Sealed takes are immutable and shared, the editor can hold on
+    to one while the history drops it.
+
+    The history keeps the takes within a memory cap: when a new take does not
+    fit, the oldest takes go first, but the best one (at the threshold used at
+    the time) is kept. Its generation changes with every add, replace and
+    eviction, so a view of the list knows when to refresh it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "MidiDiffScoreCurve.h"
+
+class MidiDiffTake
+{
+public:
+    typedef std::vector< std::tuple<long, int> > NoteListType;
+
+    // reference and performance have to be sorted by time, distances belong to reference and
+    // were computed with the given alignment mode
+    MidiDiffTake(uint32_t id, int alignment, const NoteListType& reference, const NoteListType& performance, std::vector<int> distances)
+        : id(id), alignment(alignment) {
+        startMillis = reference.empty() ? 0 : std::get<0>(reference.front());
+        if (! performance.empty()) {
+            startMillis = reference.empty() ? std::get<0>(performance.front()) : std::min(startMillis, std::get<0>(performance.front()));
+        }
+        compact(reference, referenceNotes);
+        compact(performance, performanceNotes);
+        scoreCurve.build(std::move(distances));
+    }
+
+    uint32_t getId() const {
+        return id;
+    }
+
+    int getAlignment() const {
+        return alignment;
+    }
+
+    size_t getNumReferenceNotes() const {
+        return referenceNotes.size();
+    }
+
+    const MidiDiffScoreCurve& getScoreCurve() const {
+        return scoreCurve;
+    }
+
+    NoteListType getReference() const {
+        return expand(referenceNotes);
+    }
+
+    NoteListType getPerformance() const {
+        return expand(performanceNotes);
+    }
+
+    size_t memoryBytes() const {
+        return sizeof(*this)
+            + (referenceNotes.size() + performanceNotes.size()) * sizeof(Note)
+            + scoreCurve.size() * (sizeof(int) + sizeof(int64_t));
+    }
+
+private:
+    struct Note
+    {
+        int32_t offsetMillis;
+        uint8_t note;
+    };
+
+    void compact(const NoteListType& events, std::vector<Note>& notes) {
+        notes.reserve(events.size());
+        for (auto& event : events) {
+            notes.push_back({ int32_t(std::get<0>(event) - startMillis), uint8_t(std::get<1>(event)) });
+        }
+    }
+
+    NoteListType expand(const std::vector<Note>& notes) const {
+        NoteListType events;
+        events.reserve(notes.size());
+        for (auto& note : notes) {
+            events.push_back(std::make_tuple(startMillis + note.offsetMillis, int(note.note)));
+        }
+        return events;
+    }
+
+    uint32_t id;
+    int alignment;
+    long startMillis;
+    std::vector<Note> referenceNotes;
+    std::vector<Note> performanceNotes;
+    MidiDiffScoreCurve scoreCurve;
+};
+
+
+class MidiDiffTakeHistory
+{
+public:
+    typedef std::shared_ptr<const MidiDiffTake> TakePtr;
+
+    static constexpr size_t defaultMemoryCapBytes = 32 * 1024 * 1024;
+
+    size_t getMemoryCap() const {
+        return memoryCapBytes;
+    }
+
+    // a smaller cap evicts takes right away, unless some are still scored with another alignment
+    void setMemoryCap(size_t bytes, int threshold, int alignment) {
+        memoryCapBytes = bytes;
+        enforceMemoryCap(threshold, alignment);
+    }
+
+    uint64_t getGeneration() const {
+        return generation;
+    }
+
+    void add(TakePtr take, int threshold) {
+        auto alignment = take->getAlignment();
+        takes.push_back(std::move(take));
+        generation++;
+        enforceMemoryCap(threshold, alignment);
+    }
+
+    // the eviction skipped while takes were stale is caught up once the last one is realigned
+    void replace(size_t index, TakePtr take, int threshold) {
+        auto alignment = take->getAlignment();
+        takes[index] = std::move(take);
+        generation++;
+        enforceMemoryCap(threshold, alignment);
+    }
+
+    // index of the take with this id, or -1 if it is not (or no longer) kept
+    int indexOf(uint32_t id) const {
+        for (size_t i = 0; i < takes.size(); i++) {
+            if (takes[i]->getId() == id) { return int(i); }
+        }
+        return -1;
+    }
+
+    size_t size() const {
+        return takes.size();
+    }
+
+    const TakePtr& operator[](size_t index) const {
+        return takes[index];
+    }
+
+    // index of the take with the highest percentage at threshold among the takes scored with
+    // alignment, or -1 without such takes; scores of different alignments are not comparable
+    int bestTake(int threshold, int alignment) const {
+        int best = -1;
+        double bestPercentage = 0.0;
+        for (size_t i = 0; i < takes.size(); i++) {
+            if (takes[i]->getAlignment() != alignment) { continue; }
+            auto percentage = takes[i]->getScoreCurve().percentageAt(threshold);
+            if (best < 0 || percentage > bestPercentage) {
+                best = int(i);
+                bestPercentage = percentage;
+            }
+        }
+        return best;
+    }
+
+private:
+    // While any take is scored with another alignment the best one is not known yet,
+    // so nothing is evicted until all of them are realigned.
+    void enforceMemoryCap(int threshold, int alignment) {
+        auto used = size_t(0);
+        for (auto& take : takes) {
+            if (take->getAlignment() != alignment) { return; }
+            used += take->memoryBytes();
+        }
+
+        auto best = bestTake(threshold, alignment);
+        size_t index = 0;
+        while (used > memoryCapBytes && index < takes.size()) {
+            if (int(index) == best) {
+                index++;
+                continue;
+            }
+            used -= takes[index]->memoryBytes();
+            takes.erase(takes.begin() + long(index));
+            generation++;
+            if (int(index) < best) { best--; }
+        }
+    }
+
+    std::vector<TakePtr> takes;
+    size_t memoryCapBytes = defaultMemoryCapBytes;
+    uint64_t generation = 0;
+};
@@ -0,0 +1,272 @@
+/*
+  ==============================================================================
+
+    Dynamic time warping of the performance notes onto the reference notes.
+
+    Both sequences are compared note by note: a cell costs 1 when the pitches
+    differ, plus up to 0.5 for how much the (log) inter-onset intervals
+    disagree, so the warping follows the melody and tolerates tempo drift.
+
+    The search is restricted to a Sakoe-Chiba band of bandRadius notes around
+    the diagonal, and the path is recovered Hirschberg-style: the cost rows are
+    computed forwards and backwards to the middle row, the best crossing is
+    kept and both halves are solved recursively. Only sub-problems with fewer
+    than fullMatrixCells band cells are solved with a direction matrix, so the
+    memory stays linear in the number of notes (a few MB for 100k notes).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+class MidiDiffTimeWarp
+{
+public:
+    typedef std::vector< std::tuple<long, int> > NoteListType;
+
+    static constexpr int64_t fullMatrixCells = 1 << 23;
+
+    // Both lists must be sorted by time. Returns, for each reference note, the index
+    // of the performance note with the same pitch it is warped onto, or -1.
+    static std::vector<int> align(const NoteListType& reference, const NoteListType& performance, int bandRadius) {
+        MidiDiffTimeWarp warp(reference, performance, bandRadius);
+        if (! reference.empty() && ! performance.empty()) {
+            warp.solve(0, 0, warp.rows - 1, warp.columns - 1);
+        }
+        return warp.matches;
+    }
+
+    // matched neighbours on each side that the local tempo drift is averaged over
+    static constexpr int residualWindow = 8;
+
+    // Distance of each reference note from its warped partner, after removing the local
+    // tempo drift (the average of the offsets of up to window matched neighbours on each side,
+    // as many on both). Missing notes get threshold.
+    static std::vector<int> residualDistances(const NoteListType& reference, const NoteListType& performance,
+                                              const std::vector<int>& matches, int threshold, int window = residualWindow) {
+        std::vector<int> matchedReference;
+        std::vector<long> offsetSums(1, 0);
+        for (size_t i = 0; i < matches.size(); i++) {
+            if (matches[i] < 0) { continue; }
+            matchedReference.push_back(int(i));
+            long offset = std::get<0>(performance[matches[i]]) - std::get<0>(reference[i]);
+            offsetSums.push_back(offsetSums.back() + offset);
+        }
+
+        std::vector<int> distances(reference.size(), threshold);
+        int matchedCount = int(matchedReference.size());
+        for (int k = 0; k < matchedCount; k++) {
+            // symmetric around k, also near the ends, so that a steady tempo change averages out
+            int radius = std::min(window, std::min(k, matchedCount - 1 - k));
+            int from = k - radius;
+            int to = k + radius + 1;
+            double drift = (offsetSums[to] - offsetSums[from]) * 1.0 / (to - from);
+            double offset = offsetSums[k + 1] - offsetSums[k];
+            int residual = int(std::lround(std::abs(offset - drift)));
+            distances[matchedReference[k]] = std::min(residual, threshold);
+        }
+        return distances;
+    }
+
+private:
+    MidiDiffTimeWarp(const NoteListType& reference, const NoteListType& performance, int bandRadius)
+        : rows(long(reference.size())), columns(long(performance.size())), bandRadius(std::max(1, bandRadius)) {
+        toNotes(reference, referenceNotes, referenceTempo);
+        toNotes(performance, performanceNotes, performanceTempo);
+        for (int d = 0; d < 256; d++) {
+            float ratio = std::exp2(-d / 8.0f);
+            tempoCost[d] = 0.5f * (1.0f - ratio) / (1.0f + ratio);
+        }
+        matches.assign(reference.size(), -1);
+        // rows are stored shifted by one, so that columns -1 and `columns` exist as padding
+        forwardRow.assign(performance.size() + 2, infinity);
+        forwardPrevious.assign(performance.size() + 2, infinity);
+        backwardRow.assign(performance.size() + 2, infinity);
+        backwardPrevious.assign(performance.size() + 2, infinity);
+    }
+
+    // the inter-onset interval is kept as a log2 value in 1/8 octave steps
+    static void toNotes(const NoteListType& events, std::vector<uint8_t>& notes, std::vector<uint8_t>& tempo) {
+        notes.resize(events.size());
+        tempo.resize(events.size());
+        for (size_t i = 0; i < events.size(); i++) {
+            long interval = i == 0 ? 0 : std::max(0L, std::get<0>(events[i]) - std::get<0>(events[i - 1]));
+            notes[i] = uint8_t(std::get<1>(events[i]));
+            tempo[i] = uint8_t(std::min(255L, std::lround(8.0 * std::log2(1.0 + interval))));
+        }
+    }
+
+    float cost(long i, long j) const {
+        int tempoDifference = std::abs(int(referenceTempo[i]) - int(performanceTempo[j]));
+        return (referenceNotes[i] == performanceNotes[j] ? 0.0f : 1.0f) + tempoCost[tempoDifference];
+    }
+
+    // Sakoe-Chiba band, widened by the slope so that consecutive rows always overlap
+    long bandLow(long i) const {
+        return std::max(0L, long(int64_t(i) * columns / rows) - bandRadius);
+    }
+
+    long bandHigh(long i) const {
+        return std::min(columns - 1, long(int64_t(i + 1) * columns / rows) + bandRadius);
+    }
+
+    void solve(long i0, long j0, long i1, long j1) {
+        if (i0 == i1) {
+            for (long j = j0; j <= j1; j++) { visit(i0, j); }
+            return;
+        }
+        if (j0 == j1) {
+            for (long i = i0; i <= i1; i++) { visit(i, j0); }
+            return;
+        }
+        if (bandCells(i0, j0, i1, j1) <= fullMatrixCells) {
+            solveFullMatrix(i0, j0, i1, j1);
+            return;
+        }
+
+        long middle = (i0 + i1) / 2;
+        forwardPass(i0, j0, middle, j1);
+        backwardPass(i1, j1, middle + 1, j0);
+
+        // the path leaves (middle, j) either down to (middle + 1, j) or diagonally to (middle + 1, j + 1)
+        float best = infinity;
+        long splitColumn = j0;
+        long nextColumn = j0;
+        for (long j = std::max(j0, bandLow(middle)); j <= std::min(j1, bandHigh(middle)); j++) {
+            float down = backwardRow[j + 1];
+            float diagonal = backwardRow[j + 2];
+            float through = forwardRow[j + 1] + std::min(down, diagonal);
+            if (through < best) {
+                best = through;
+                splitColumn = j;
+                nextColumn = diagonal < down ? j + 1 : j;
+            }
+        }
+
+        solve(i0, j0, middle, splitColumn);
+        solve(middle + 1, nextColumn, i1, j1);
+    }
+
+    int64_t bandCells(long i0, long j0, long i1, long j1) const {
+        int64_t cells = 0;
+        for (long i = i0; i <= i1 && cells <= fullMatrixCells; i++) {
+            cells += std::min(j1, bandHigh(i)) - std::max(j0, bandLow(i)) + 1;
+        }
+        return cells;
+    }
+
+    // Leaves the accumulated costs of row lastRow in forwardRow. Cells outside the band
+    // read as infinity, the start cell sees a zero on its diagonal.
+    void forwardPass(long i0, long j0, long lastRow, long j1) {
+        std::fill(forwardRow.begin() + j0, forwardRow.begin() + j1 + 3, infinity);
+        std::fill(forwardPrevious.begin() + j0, forwardPrevious.begin() + j1 + 3, infinity);
+        forwardRow[j0] = 0.0f;
+
+        for (long i = i0; i <= lastRow; i++) {
+            std::swap(forwardRow, forwardPrevious);
+            long low = std::max(j0, bandLow(i));
+            long high = std::min(j1, bandHigh(i));
+            float* row = forwardRow.data() + 1;
+            const float* previous = forwardPrevious.data() + 1;
+            row[low - 1] = infinity;
+            for (long j = low; j <= high; j++) {
+                row[j] = cost(i, j) + std::min(std::min(previous[j], previous[j - 1]), row[j - 1]);
+            }
+        }
+    }
+
+    // Mirror image of forwardPass, the costs of row lastRow towards (i1, j1) end up in backwardRow.
+    void backwardPass(long i1, long j1, long lastRow, long j0) {
+        std::fill(backwardRow.begin() + j0, backwardRow.begin() + j1 + 3, infinity);
+        std::fill(backwardPrevious.begin() + j0, backwardPrevious.begin() + j1 + 3, infinity);
+        backwardRow[j1 + 2] = 0.0f;
+
+        for (long i = i1; i >= lastRow; i--) {
+            std::swap(backwardRow, backwardPrevious);
+            long low = std::max(j0, bandLow(i));
+            long high = std::min(j1, bandHigh(i));
+            float* row = backwardRow.data() + 1;
+            const float* previous = backwardPrevious.data() + 1;
+            row[high + 1] = infinity;
+            for (long j = high; j >= low; j--) {
+                row[j] = cost(i, j) + std::min(std::min(previous[j], previous[j + 1]), row[j + 1]);
+            }
+        }
+    }
+
+    // Only the band cells of each row get a direction, packed four to a byte.
+    void solveFullMatrix(long i0, long j0, long i1, long j1) {
+        enum : uint8_t { fromDiagonal, fromAbove, fromLeft };
+        std::fill(forwardRow.begin() + j0, forwardRow.begin() + j1 + 3, infinity);
+        std::fill(forwardPrevious.begin() + j0, forwardPrevious.begin() + j1 + 3, infinity);
+        forwardRow[j0] = 0.0f;
+
+        rowStarts.clear();
+        directions.clear();
+        size_t cell = 0;
+        for (long i = i0; i <= i1; i++) {
+            std::swap(forwardRow, forwardPrevious);
+            long low = std::max(j0, bandLow(i));
+            long high = std::min(j1, bandHigh(i));
+            float* row = forwardRow.data() + 1;
+            const float* previous = forwardPrevious.data() + 1;
+            row[low - 1] = infinity;
+            rowStarts.push_back(cell);
+            directions.resize((cell + size_t(high - low + 1) + 3) / 4, 0);
+            for (long j = low; j <= high; j++, cell++) {
+                float best = previous[j - 1];
+                uint8_t direction = fromDiagonal;
+                if (previous[j] < best) { best = previous[j]; direction = fromAbove; }
+                if (row[j - 1] < best) { best = row[j - 1]; direction = fromLeft; }
+                row[j] = cost(i, j) + best;
+                directions[cell / 4] |= uint8_t(direction << (cell % 4 * 2));
+            }
+        }
+
+        path.clear();
+        long i = i1, j = j1;
+        while (true) {
+            path.push_back(std::make_pair(i, j));
+            if (i == i0 && j == j0) { break; }
+            auto index = rowStarts[size_t(i - i0)] + size_t(j - std::max(j0, bandLow(i)));
+            auto direction = (directions[index / 4] >> (index % 4 * 2)) & 3;
+            if (direction != fromLeft) { i--; }
+            if (direction != fromAbove) { j--; }
+        }
+        for (auto cell = path.rbegin(); cell != path.rend(); ++cell) {
+            visit(cell->first, cell->second);
+        }
+    }
+
+    // cells arrive in path order, so a performance note is never matched twice
+    void visit(long i, long j) {
+        if (matches[i] >= 0 || j <= lastMatchedColumn) { return; }
+        if (referenceNotes[i] == performanceNotes[j]) {
+            matches[i] = int(j);
+            lastMatchedColumn = j;
+        }
+    }
+
+    static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+    long rows;
+    long columns;
+    long bandRadius;
+    long lastMatchedColumn = -1;
+
+    std::vector<uint8_t> referenceNotes, performanceNotes;
+    std::vector<uint8_t> referenceTempo, performanceTempo;
+    float tempoCost[256];
+    std::vector<float> forwardRow, forwardPrevious, backwardRow, backwardPrevious;
+    std::vector<size_t> rowStarts;
+    std::vector<uint8_t> directions;
+    std::vector< std::pair<long, long> > path;
+    std::vector<int> matches;
+};
@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    Tests of MidiDiffTimeWarp: a drifting performance with missing and extra
+    notes is warped onto its known partners, the residuals only keep the
+    deviations that are not tempo drift, and 100k notes align in bounded time.
+
+    They are compiled when JUCE_UNIT_TESTS is enabled and run in the "MidiDiff"
+    category, e.g. with juce::UnitTestRunner().runTestsInCategory("MidiDiff").
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "MidiDiffTimeWarp.h"
+
+#if JUCE_UNIT_TESTS
+
+class MidiDiffTimeWarpTest : public juce::UnitTest
+{
+public:
+    MidiDiffTimeWarpTest() : juce::UnitTest("MidiDiffTimeWarp", "MidiDiff") {}
+
+    void runTest() override
+    {
+        typedef MidiDiffTimeWarp::NoteListType NoteListType;
+
+        beginTest("A drifting performance with missing and extra notes is warped onto its partners");
+        {
+            // the performance slows down by 10% over the piece, reference notes 10 and 25 are not
+            // played, and two wrong notes are played after 5 and 30; note 20 is 80 ms late
+            const int notes = 40;
+            NoteListType reference, performance;
+            std::vector<int> partners(notes, -1);
+            double time = 0.0;
+            for (int i = 0; i < notes; i++) {
+                int pitch = 60 + (i * 5) % 12;
+                reference.push_back(std::make_tuple(long(i * 250), pitch));
+
+                if (i > 0) { time += 250.0 * (1.0 + 0.1 * i / notes); }
+                if (i != 10 && i != 25) {
+                    partners[i] = int(performance.size());
+                    performance.push_back(std::make_tuple(long(time) + (i == 20 ? 80 : 0), pitch));
+                }
+                if (i == 5 || i == 30) {
+                    performance.push_back(std::make_tuple(long(time) + 100, 90));
+                }
+            }
+
+            auto matches = MidiDiffTimeWarp::align(reference, performance, 16);
+            expectEquals(int(matches.size()), notes);
+            for (int i = 0; i < notes; i++) {
+                expectEquals(matches[i], partners[i], "reference note " + juce::String(i));
+            }
+
+            const int threshold = 200;
+            auto distances = MidiDiffTimeWarp::residualDistances(reference, performance, matches, threshold);
+            expectEquals(distances[10], threshold);
+            expectEquals(distances[25], threshold);
+            expect(distances[20] > 50, "the late note keeps most of its deviation");
+            for (int i = 0; i < notes; i++) {
+                if (i == 10 || i == 25 || std::abs(i - 20) <= MidiDiffTimeWarp::residualWindow) { continue; }
+                expect(distances[i] < 30, "the drift is removed from note " + juce::String(i));
+            }
+        }
+
+        beginTest("100k notes align in bounded time");
+        {
+            const int notes = 100000;
+            NoteListType reference, performance;
+            reference.reserve(notes);
+            performance.reserve(notes);
+            uint32_t random = 12345;
+            double time = 0.0;
+            for (int i = 0; i < notes; i++) {
+                random = random * 1664525u + 1013904223u;
+                int pitch = 48 + int((random >> 16) % 36);
+                reference.push_back(std::make_tuple(long(i) * 200, pitch));
+                // 3% slower, with up to 20 ms of jitter
+                time += i == 0 ? 0.0 : 206.0;
+                performance.push_back(std::make_tuple(long(time) + long((random >> 8) % 21), pitch));
+            }
+
+            auto start = juce::Time::getMillisecondCounterHiRes();
+            auto matches = MidiDiffTimeWarp::align(reference, performance, 128);
+            auto elapsed = juce::Time::getMillisecondCounterHiRes() - start;
+
+            int correct = 0;
+            for (int i = 0; i < notes; i++) {
+                if (matches[size_t(i)] == i) { correct++; }
+            }
+            expect(correct > notes * 95 / 100, juce::String(correct) + " of the notes aligned with their partner");
+            // loose, so that unoptimised Debug builds pass too (a Release build needs well under a second)
+            expect(elapsed < 30000.0, "aligning took " + juce::String(elapsed) + " ms");
+        }
+    }
+};
+
+static MidiDiffTimeWarpTest midiDiffTimeWarpTest;
+
+#endif